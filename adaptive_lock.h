@@ -0,0 +1,117 @@
+#ifndef ADAPTIVE_LOCK_H
+#define ADAPTIVE_LOCK_H
+
+#include <atomic>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/*
+Гибридная блокировка: сначала крутится в цикле с экспоненциальной задержкой на
+инструкции pause, затем засыпает на futex. Длина фазы ожидания подстраивается сама:
+скользящее среднее числа итераций, за которое блокировка обычно освобождается.
+Если владелец вытеснен и ожидание стабильно заканчивается засыпанием, предел
+уменьшается, и блокировка ведет себя как мьютекс; без конкуренции захват стоит
+одной операции compare_exchange, как у спинлока.
+Состояния как у futex-мьютекса Дреппера: 0 - свободна, 1 - захвачена, 2 - есть спящие
+*/
+class AdaptiveLock
+{
+public:
+    static const int MIN_SPIN = 16;    // Нижняя граница фазы ожидания (в итерациях pause)
+    static const int MAX_SPIN = 4096;  // Верхняя граница фазы ожидания
+    static const int MAX_BACKOFF = 64; // Максимальная задержка между попытками
+
+    void lock()
+    {
+        int c = 0;
+        if (state.compare_exchange_strong(c, 1, std::memory_order_acquire))
+            return;
+        if (spin_phase())
+            return;
+        // Фаза засыпания
+        if (c != 2)
+            c = state.exchange(2, std::memory_order_acquire);
+        while (c != 0)
+        {
+            futex(FUTEX_WAIT_PRIVATE, 2);
+            c = state.exchange(2, std::memory_order_acquire);
+        }
+    }
+
+    bool try_lock()
+    {
+        int c = 0;
+        return state.compare_exchange_strong(c, 1, std::memory_order_acquire);
+    }
+
+    void unlock()
+    {
+        if (state.fetch_sub(1, std::memory_order_release) != 1)
+        {
+            state.store(0, std::memory_order_release);
+            futex(FUTEX_WAKE_PRIVATE, 1);
+        }
+    }
+
+    /* Текущий предел фазы ожидания, для отладки и отчетов */
+    int spin_limit() const
+    {
+        return spin_estimate.load(std::memory_order_relaxed);
+    }
+
+private:
+    static void cpu_relax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield" ::: "memory");
+#endif
+    }
+
+    void futex(int op, int value)
+    {
+        syscall(SYS_futex, reinterpret_cast<int *>(&state), op, value, nullptr, nullptr, 0);
+    }
+
+    /* Ожидание в цикле. Возвращает true, если блокировку удалось захватить не засыпая */
+    bool spin_phase()
+    {
+        int limit = spin_estimate.load(std::memory_order_relaxed);
+        int backoff = 1;
+        int spins = 0;
+        while (spins < limit)
+        {
+            for (int i = 0; i < backoff; ++i)
+                cpu_relax();
+            spins += backoff;
+            backoff = backoff * 2 < MAX_BACKOFF ? backoff * 2 : MAX_BACKOFF;
+            // Пока есть спящие, захват через 0 -> 1 потерял бы их пробуждение
+            int c = state.load(std::memory_order_relaxed);
+            if (c == 0 && state.compare_exchange_weak(c, 1, std::memory_order_acquire))
+            {
+                // Удачное ожидание: подтягиваем предел к удвоенному числу итераций
+                update_estimate(limit, spins * 2);
+                return true;
+            }
+            if (c == 2)
+                break;
+        }
+        // Ожидание не помогло: сокращаем фазу
+        update_estimate(limit, limit / 2);
+        return false;
+    }
+
+    void update_estimate(int current, int target)
+    {
+        int next = current + (target - current) / 8;
+        next = next < MIN_SPIN ? MIN_SPIN : (next > MAX_SPIN ? MAX_SPIN : next);
+        spin_estimate.store(next, std::memory_order_relaxed);
+    }
+
+    std::atomic<int> state{0};
+    std::atomic<int> spin_estimate{MAX_SPIN / 4};
+};
+
+#endif
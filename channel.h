@@ -0,0 +1,113 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+/*
+Ограниченный канал для M производителей и N потребителей. Кольцевой буфер под
+мьютексом и две условные переменные: производители спят, пока буфер полон,
+потребители - пока он пуст. После close() новые элементы не принимаются, а
+потребители дочитывают оставшиеся и получают false.
+push_n/pop_n передают пачку за один захват мьютекса
+*/
+template <typename T>
+class BoundedChannel
+{
+public:
+    explicit BoundedChannel(size_t capacity) : buffer(capacity > 0 ? capacity : 1) {}
+
+    BoundedChannel(const BoundedChannel &) = delete;
+    BoundedChannel &operator=(const BoundedChannel &) = delete;
+
+    /* Помещает элемент, ожидая свободного места. false, если канал закрыт */
+    bool push(const T &item)
+    {
+        return push_n(&item, 1) == 1;
+    }
+
+    /*
+    Помещает до count элементов, ожидая места под каждую порцию. Возвращает число
+    помещенных элементов: меньше count, только если канал закрыли во время ожидания
+    */
+    size_t push_n(const T *items, size_t count)
+    {
+        size_t pushed = 0;
+        std::unique_lock<std::mutex> guard(mutex);
+        while (pushed < count)
+        {
+            not_full.wait(guard, [this] { return closed || size < buffer.size(); });
+            if (closed)
+                break;
+            size_t portion = std::min(count - pushed, buffer.size() - size);
+            for (size_t i = 0; i < portion; ++i)
+            {
+                buffer[(head + size) % buffer.size()] = items[pushed + i];
+                ++size;
+            }
+            pushed += portion;
+            // Будим столько потребителей, сколько элементов появилось
+            if (portion == 1)
+                not_empty.notify_one();
+            else
+                not_empty.notify_all();
+        }
+        return pushed;
+    }
+
+    /* Забирает элемент, ожидая его появления. false, если канал закрыт и пуст */
+    bool pop(T &item)
+    {
+        return pop_n(&item, 1) == 1;
+    }
+
+    /*
+    Забирает от 1 до max_count элементов, ожидая хотя бы одного. Возвращает 0,
+    только если канал закрыт и пуст
+    */
+    size_t pop_n(T *items, size_t max_count)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        not_empty.wait(guard, [this] { return closed || size > 0; });
+        size_t portion = std::min(max_count, size);
+        for (size_t i = 0; i < portion; ++i)
+        {
+            items[i] = buffer[head];
+            head = (head + 1) % buffer.size();
+        }
+        size -= portion;
+        if (portion == 1)
+            not_full.notify_one();
+        else if (portion > 1)
+            not_full.notify_all();
+        return portion;
+    }
+
+    /* Закрывает канал и будит всех ожидающих */
+    void close()
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        closed = true;
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+
+    size_t capacity() const
+    {
+        return buffer.size();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable not_full;  // Сигнал производителям: появилось место
+    std::condition_variable not_empty; // Сигнал потребителям: появились элементы
+    std::vector<T> buffer;
+    size_t head = 0; // Индекс самого старого элемента
+    size_t size = 0; // Количество элементов в буфере
+    bool closed = false;
+};
+
+#endif
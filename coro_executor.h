@@ -0,0 +1,303 @@
+#ifndef CORO_EXECUTOR_H
+#define CORO_EXECUTOR_H
+
+/* Требует C++20 (-std=c++20) */
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+class Executor;
+
+/*
+Задание-сопрограмма, запускаемое через Executor::spawn. Создается приостановленным,
+после завершения уничтожает себя само и сообщает исполнителю, что стало на одно
+живое задание меньше
+*/
+class AsyncTask
+{
+public:
+    struct promise_type
+    {
+        Executor *executor = nullptr;
+
+        AsyncTask get_return_object()
+        {
+            return AsyncTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept { return false; }
+            void await_suspend(std::coroutine_handle<promise_type> handle) noexcept;
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    explicit AsyncTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    std::coroutine_handle<promise_type> handle;
+};
+
+/*
+Исполнитель сопрограмм: несколько рабочих потоков разбирают общую очередь готовых
+сопрограмм, а отдельный поток-реактор ждет в epoll_wait таймеров и готовности
+дескрипторов. Все таймеры сведены в одну кучу по сроку и один timerfd, взведенный
+на ближайший срок, поэтому тысячи ожидающих заданий не занимают ни потоков, ни
+дескрипторов
+*/
+class Executor
+{
+public:
+    explicit Executor(int workers)
+    {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd < 0 || timer_fd < 0 || wake_fd < 0)
+            throw std::runtime_error("Cannot create reactor descriptors");
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.ptr = &timer_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &event);
+        event.data.ptr = &wake_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event);
+        reactor = std::thread(&Executor::reactor_loop, this);
+        for (int i = 0; i < (workers > 0 ? workers : 1); ++i)
+            threads.emplace_back(&Executor::worker_loop, this);
+    }
+
+    ~Executor()
+    {
+        {
+            std::lock_guard<std::mutex> guard(ready_mutex);
+            stopping = true;
+        }
+        ready_cond.notify_all();
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) < 0)
+        {
+            // Реактор все равно проснется на следующем таймере
+        }
+        for (auto &thread : threads)
+            thread.join();
+        reactor.join();
+        close(epoll_fd);
+        close(timer_fd);
+        close(wake_fd);
+    }
+
+    /* Запуск задания: сопрограмма ставится в очередь готовых */
+    void spawn(AsyncTask task)
+    {
+        task.handle.promise().executor = this;
+        live.fetch_add(1, std::memory_order_relaxed);
+        schedule(task.handle);
+    }
+
+    /* Ожидание завершения всех запущенных заданий */
+    void wait_all()
+    {
+        std::unique_lock<std::mutex> guard(done_mutex);
+        done_cond.wait(guard, [this] { return live.load(std::memory_order_acquire) == 0; });
+    }
+
+    /* co_await executor.sleep_for(d): приостанавливает задание на d, не занимая поток */
+    auto sleep_for(std::chrono::nanoseconds delay)
+    {
+        struct SleepAwaiter
+        {
+            Executor *executor;
+            std::chrono::steady_clock::time_point deadline;
+            bool await_ready() const { return deadline <= std::chrono::steady_clock::now(); }
+            void await_suspend(std::coroutine_handle<> handle) { executor->add_timer(deadline, handle); }
+            void await_resume() const {}
+        };
+        return SleepAwaiter{this, std::chrono::steady_clock::now() + delay};
+    }
+
+    /* co_await executor.readable(fd) / writable(fd): ожидание готовности дескриптора */
+    auto readable(int fd) { return IoAwaiter{this, fd, EPOLLIN}; }
+    auto writable(int fd) { return IoAwaiter{this, fd, EPOLLOUT}; }
+
+    /* co_await executor.yield(): уступить рабочий поток другим готовым заданиям */
+    auto yield()
+    {
+        struct YieldAwaiter
+        {
+            Executor *executor;
+            bool await_ready() const { return false; }
+            void await_suspend(std::coroutine_handle<> handle) { executor->schedule(handle); }
+            void await_resume() const {}
+        };
+        return YieldAwaiter{this};
+    }
+
+    void schedule(std::coroutine_handle<> handle)
+    {
+        {
+            std::lock_guard<std::mutex> guard(ready_mutex);
+            ready.push_back(handle);
+        }
+        ready_cond.notify_one();
+    }
+
+    void task_finished()
+    {
+        if (live.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            std::lock_guard<std::mutex> guard(done_mutex);
+            done_cond.notify_all();
+        }
+    }
+
+private:
+    /* Ожидание дескриптора: регистрация в epoll с EPOLLONESHOT, data.ptr - ожидающая сопрограмма */
+    struct IoAwaiter
+    {
+        Executor *executor;
+        int fd;
+        uint32_t events;
+        bool await_ready() const { return false; }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            epoll_event event = {};
+            event.events = events | EPOLLONESHOT;
+            event.data.ptr = handle.address();
+            if (epoll_ctl(executor->epoll_fd, EPOLL_CTL_MOD, fd, &event) != 0)
+                epoll_ctl(executor->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        }
+        void await_resume() const {}
+    };
+
+    struct Timer
+    {
+        std::chrono::steady_clock::time_point deadline;
+        std::coroutine_handle<> handle;
+        bool operator>(const Timer &other) const { return deadline > other.deadline; }
+    };
+
+    void add_timer(std::chrono::steady_clock::time_point deadline, std::coroutine_handle<> handle)
+    {
+        std::lock_guard<std::mutex> guard(timers_mutex);
+        bool earliest = timers.empty() || deadline < timers.top().deadline;
+        timers.push({deadline, handle});
+        if (earliest)
+            arm_timer(deadline);
+    }
+
+    /* Взводит timerfd на абсолютный срок deadline (вызывается под timers_mutex) */
+    void arm_timer(std::chrono::steady_clock::time_point deadline)
+    {
+        // steady_clock в Linux идет по CLOCK_MONOTONIC, поэтому срок переводится напрямую
+        auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+        if (since_epoch <= 0)
+            since_epoch = 1;
+        itimerspec spec = {};
+        spec.it_value.tv_sec = since_epoch / 1000000000;
+        spec.it_value.tv_nsec = since_epoch % 1000000000;
+        timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+
+    /* Переносит истекшие таймеры в очередь готовых и перевзводит timerfd */
+    void fire_timers()
+    {
+        uint64_t expirations;
+        if (read(timer_fd, &expirations, sizeof(expirations)) < 0)
+        {
+            // Таймер мог быть перевзведен между событием и чтением
+        }
+        std::vector<std::coroutine_handle<>> expired;
+        {
+            std::lock_guard<std::mutex> guard(timers_mutex);
+            auto now = std::chrono::steady_clock::now();
+            while (!timers.empty() && timers.top().deadline <= now)
+            {
+                expired.push_back(timers.top().handle);
+                timers.pop();
+            }
+            if (!timers.empty())
+                arm_timer(timers.top().deadline);
+        }
+        if (expired.empty())
+            return;
+        {
+            std::lock_guard<std::mutex> guard(ready_mutex);
+            ready.insert(ready.end(), expired.begin(), expired.end());
+        }
+        ready_cond.notify_all();
+    }
+
+    void reactor_loop()
+    {
+        const int MAX_EVENTS = 256;
+        epoll_event events[MAX_EVENTS];
+        while (true)
+        {
+            int count = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+            for (int i = 0; i < count; ++i)
+            {
+                void *tag = events[i].data.ptr;
+                if (tag == &timer_fd)
+                    fire_timers();
+                else if (tag == &wake_fd)
+                    return;
+                else
+                    schedule(std::coroutine_handle<>::from_address(tag));
+            }
+        }
+    }
+
+    void worker_loop()
+    {
+        while (true)
+        {
+            std::coroutine_handle<> handle;
+            {
+                std::unique_lock<std::mutex> guard(ready_mutex);
+                ready_cond.wait(guard, [this] { return stopping || !ready.empty(); });
+                if (ready.empty())
+                    return;
+                handle = ready.front();
+                ready.pop_front();
+            }
+            handle.resume();
+        }
+    }
+
+    int epoll_fd, timer_fd, wake_fd;
+    std::thread reactor;
+    std::vector<std::thread> threads;
+    std::mutex ready_mutex;
+    std::condition_variable ready_cond;
+    std::deque<std::coroutine_handle<>> ready; // Сопрограммы, готовые к продолжению
+    bool stopping = false;
+    std::mutex timers_mutex;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+    std::atomic<long long> live{0}; // Запущенные и еще не завершившиеся задания
+    std::mutex done_mutex;
+    std::condition_variable done_cond;
+};
+
+inline void AsyncTask::promise_type::FinalAwaiter::await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+{
+    Executor *executor = handle.promise().executor;
+    handle.destroy();
+    executor->task_finished();
+}
+
+#endif
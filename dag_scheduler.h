@@ -0,0 +1,240 @@
+#ifndef DAG_SCHEDULER_H
+#define DAG_SCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*
+Планировщик заданий с зависимостями. Задание объявляет предшественников и
+оценку стоимости; готовым оно становится, когда выполнены все предшественники.
+Приоритет задания - длина самого дорогого пути от него до конца графа по оценкам
+(для независимых заданий это просто стоимость, т.е. порядок LPT: сначала самые
+долгие). У каждого исполнителя своя очередь готовых заданий, упорядоченная по
+приоритету; освободившиеся последователи попадают в очередь того исполнителя,
+который их освободил, а исполнитель с пустой очередью крадет лучшее задание у соседей.
+После run() доступен отчет: критический путь по замеренным длительностям против
+фактического времени выполнения
+*/
+class DagScheduler
+{
+public:
+    typedef std::function<void()> Job;
+
+    /* Добавляет задание и возвращает его номер. Предшественники должны быть добавлены раньше */
+    int add_task(Job job, double cost_estimate = 1.0, const std::vector<int> &predecessors = {})
+    {
+        int id = tasks.size();
+        tasks.push_back(Task());
+        Task &task = tasks.back();
+        task.job = std::move(job);
+        task.cost = cost_estimate;
+        task.predecessors = predecessors.size();
+        for (int predecessor : predecessors)
+        {
+            if (predecessor < 0 || predecessor >= id)
+                throw std::invalid_argument("predecessor must be added before the task");
+            tasks[predecessor].successors.push_back(id);
+        }
+        return id;
+    }
+
+    /* Выполняет все задания на workers потоках и дожидается их завершения */
+    void run(int workers)
+    {
+        workers = std::max(1, workers);
+        compute_priorities();
+        queues = std::vector<WorkerQueue>(workers);
+        completed.store(0);
+        for (Task &task : tasks)
+            task.waiting.store(task.predecessors, std::memory_order_relaxed);
+        // Начальные готовые задания раздаем по кругу в порядке убывания приоритета
+        std::vector<int> ready;
+        for (size_t id = 0; id < tasks.size(); ++id)
+        {
+            if (tasks[id].predecessors == 0)
+                ready.push_back(id);
+        }
+        std::sort(ready.begin(), ready.end(), [this](int a, int b) { return tasks[a].priority > tasks[b].priority; });
+        for (size_t i = 0; i < ready.size(); ++i)
+            queues[i % workers].ready.push({tasks[ready[i]].priority, ready[i]});
+        start_time = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int worker = 0; worker < workers; ++worker)
+            threads.emplace_back(&DagScheduler::worker_loop, this, worker);
+        for (auto &thread : threads)
+            thread.join();
+        finish_time = std::chrono::steady_clock::now();
+    }
+
+    /* Фактическое время выполнения всех заданий, с */
+    double makespan() const
+    {
+        return std::chrono::duration<double>(finish_time - start_time).count();
+    }
+
+    /* Самый длинный путь в графе по замеренным длительностям заданий, с: нижняя граница makespan */
+    double critical_path() const
+    {
+        std::vector<double> longest(tasks.size(), 0);
+        double result = 0;
+        // Номера предшественников меньше номеров последователей, поэтому обход по порядку топологический
+        for (size_t id = 0; id < tasks.size(); ++id)
+        {
+            longest[id] += tasks[id].duration;
+            for (int successor : tasks[id].successors)
+                longest[successor] = std::max(longest[successor], longest[id]);
+            result = std::max(result, longest[id]);
+        }
+        return result;
+    }
+
+    /* Сумма замеренных длительностей всех заданий, с */
+    double total_work() const
+    {
+        double sum = 0;
+        for (const Task &task : tasks)
+            sum += task.duration;
+        return sum;
+    }
+
+    /* Сколько заданий исполнители украли друг у друга */
+    long long steals() const
+    {
+        return steal_count.load();
+    }
+
+    size_t size() const
+    {
+        return tasks.size();
+    }
+
+private:
+    struct Task
+    {
+        Job job;
+        double cost = 1.0;           // Оценка стоимости
+        double priority = 0;         // Оценка длины пути до конца графа
+        int predecessors = 0;        // Количество предшественников
+        std::atomic<int> waiting{0}; // Сколько предшественников еще не выполнено
+        std::vector<int> successors;
+        double duration = 0;         // Замеренная длительность, с
+
+        Task() = default;
+        Task(Task &&other) noexcept
+            : job(std::move(other.job)), cost(other.cost), priority(other.priority),
+              predecessors(other.predecessors), waiting(other.waiting.load()),
+              successors(std::move(other.successors)), duration(other.duration)
+        {
+        }
+    };
+
+    typedef std::pair<double, int> ReadyItem; // (приоритет, номер задания)
+
+    struct alignas(64) WorkerQueue
+    {
+        std::mutex mutex;
+        std::priority_queue<ReadyItem> ready;
+    };
+
+    void compute_priorities()
+    {
+        for (size_t i = tasks.size(); i-- > 0;)
+        {
+            double tail = 0;
+            for (int successor : tasks[i].successors)
+                tail = std::max(tail, tasks[successor].priority);
+            tasks[i].priority = tasks[i].cost + tail;
+        }
+    }
+
+    /* Забирает лучшее задание из очереди worker. -1, если очередь пуста */
+    int pop_from(int worker)
+    {
+        std::lock_guard<std::mutex> guard(queues[worker].mutex);
+        if (queues[worker].ready.empty())
+            return -1;
+        int id = queues[worker].ready.top().second;
+        queues[worker].ready.pop();
+        return id;
+    }
+
+    int find_task(int worker)
+    {
+        int id = pop_from(worker);
+        if (id >= 0)
+            return id;
+        // Своя очередь пуста: обходим соседей, начиная со следующего
+        for (size_t offset = 1; offset < queues.size(); ++offset)
+        {
+            id = pop_from((worker + offset) % queues.size());
+            if (id >= 0)
+            {
+                steal_count.fetch_add(1, std::memory_order_relaxed);
+                return id;
+            }
+        }
+        return -1;
+    }
+
+    void worker_loop(int worker)
+    {
+        while (completed.load(std::memory_order_acquire) < tasks.size())
+        {
+            // Поколение читается до поиска, чтобы не пропустить задания, освобожденные во время поиска
+            unsigned long long seen = generation.load(std::memory_order_acquire);
+            int id = find_task(worker);
+            if (id < 0)
+            {
+                // Готовых заданий нет: ждем, пока кто-нибудь не освободит новые или не закончит работу
+                std::unique_lock<std::mutex> guard(idle_mutex);
+                idle.wait(guard, [this, seen] {
+                    return generation.load(std::memory_order_acquire) != seen ||
+                           completed.load(std::memory_order_acquire) >= tasks.size();
+                });
+                continue;
+            }
+            Task &task = tasks[id];
+            auto started = std::chrono::steady_clock::now();
+            task.job();
+            task.duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            int released = 0;
+            for (int successor : task.successors)
+            {
+                if (tasks[successor].waiting.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    std::lock_guard<std::mutex> guard(queues[worker].mutex);
+                    queues[worker].ready.push({tasks[successor].priority, successor});
+                    released++;
+                }
+            }
+            bool last = completed.fetch_add(1, std::memory_order_acq_rel) + 1 == tasks.size();
+            if (released > 1 || last)
+            {
+                // Одно освобожденное задание исполнитель заберет сам, остальные предлагаем спящим соседям
+                std::lock_guard<std::mutex> guard(idle_mutex);
+                generation.fetch_add(1, std::memory_order_release);
+                idle.notify_all();
+            }
+        }
+    }
+
+    std::vector<Task> tasks;
+    std::vector<WorkerQueue> queues;
+    std::atomic<size_t> completed{0};
+    std::atomic<long long> steal_count{0};
+    std::atomic<unsigned long long> generation{0}; // Меняется, когда спящим исполнителям есть что забрать
+    std::mutex idle_mutex;
+    std::condition_variable idle;
+    std::chrono::steady_clock::time_point start_time, finish_time;
+};
+
+#endif
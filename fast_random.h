@@ -0,0 +1,210 @@
+#ifndef FAST_RANDOM_H
+#define FAST_RANDOM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <immintrin.h>
+
+/*
+Генератор xoshiro256** (Blackman, Vigna): 256 бит состояния, период 2^256 - 1,
+несколько сдвигов и умножений на число. В отличие от rand() у него нет скрытого
+общего состояния: каждый поток держит свой экземпляр, поэтому генерация не
+требует синхронизации, а последовательности воспроизводятся по зерну.
+Независимые потоки чисел получаются прыжком jump() на 2^128 шагов вперед:
+stream(seed, k) - это генератор с зерном seed после k прыжков, и последовательности
+разных k не пересекаются. Класс удовлетворяет требованиям UniformRandomBitGenerator
+и подходит для распределений из <random>
+*/
+class Xoshiro256
+{
+public:
+    typedef uint64_t result_type;
+
+    explicit Xoshiro256(uint64_t seed = 42)
+    {
+        // Состояние заполняется splitmix64, чтобы близкие зерна давали несвязанные состояния
+        for (uint64_t &word : state)
+        {
+            seed += 0x9e3779b97f4a7c15ULL;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    /* Генератор для index-го независимого потока чисел с зерном seed */
+    static Xoshiro256 stream(uint64_t seed, unsigned index)
+    {
+        Xoshiro256 generator(seed);
+        for (unsigned i = 0; i < index; ++i)
+            generator.jump();
+        return generator;
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+    result_type operator()() { return next(); }
+
+    uint64_t next()
+    {
+        uint64_t result = rotl(state[1] * 5, 7) * 9;
+        uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return result;
+    }
+
+    /* Равномерное целое из [0, bound) умножением вместо деления (метод Лемира) */
+    uint64_t next_below(uint64_t bound)
+    {
+        return (uint64_t)(((unsigned __int128)next() * bound) >> 64);
+    }
+
+    /* Равномерное double из [0, 1): старшие 53 бита */
+    double next_double()
+    {
+        return (next() >> 11) * 0x1.0p-53;
+    }
+
+    /* Сдвиг на 2^128 шагов вперед */
+    void jump()
+    {
+        static const uint64_t JUMP[] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                                        0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+        uint64_t jumped[4] = {0, 0, 0, 0};
+        for (uint64_t word : JUMP)
+        {
+            for (int bit = 0; bit < 64; ++bit)
+            {
+                if (word & (1ULL << bit))
+                {
+                    for (int i = 0; i < 4; ++i)
+                        jumped[i] ^= state[i];
+                }
+                next();
+            }
+        }
+        for (int i = 0; i < 4; ++i)
+            state[i] = jumped[i];
+    }
+
+private:
+    friend class BulkRandom;
+
+    static uint64_t rotl(uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    uint64_t state[4];
+};
+
+/*
+Массовое заполнение случайными числами: четыре независимых генератора xoshiro256**
+(потоки 0..3 одного зерна) идут параллельно, out[4 * i + lane] берется из генератора
+lane. На AVX2 все четыре шага делаются одной группой векторных инструкций, без AVX2
+те же генераторы крутятся по очереди, поэтому результат от набора инструкций не зависит
+*/
+class BulkRandom
+{
+public:
+    static const int LANES = 4;
+
+    explicit BulkRandom(uint64_t seed = 42)
+    {
+        Xoshiro256 generator(seed);
+        for (int lane = 0; lane < LANES; ++lane)
+        {
+            // Состояние генераторов хранится по словам: state[word][lane]
+            for (int word = 0; word < 4; ++word)
+                state[word][lane] = generator.state[word];
+            generator.jump();
+        }
+    }
+
+    /* Заполняет out[0..count) случайными 64-битными числами */
+    void fill(uint64_t *out, size_t count)
+    {
+        size_t i = 0;
+        if (__builtin_cpu_supports("avx2"))
+            i = fill_avx2(out, count);
+        for (; i + LANES <= count; i += LANES)
+            step_scalar(out + i);
+        if (i < count)
+        {
+            // Хвост короче группы: генерируем целую группу и берем ее начало
+            uint64_t group[LANES];
+            step_scalar(group);
+            for (int lane = 0; i < count; ++lane, ++i)
+                out[i] = group[lane];
+        }
+    }
+
+private:
+    static uint64_t rotl(uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    void step_scalar(uint64_t *out)
+    {
+        for (int lane = 0; lane < LANES; ++lane)
+        {
+            uint64_t s1 = state[1][lane];
+            out[lane] = rotl(s1 * 5, 7) * 9;
+            uint64_t t = s1 << 17;
+            state[2][lane] ^= state[0][lane];
+            state[3][lane] ^= s1;
+            state[1][lane] ^= state[2][lane];
+            state[0][lane] ^= state[3][lane];
+            state[2][lane] ^= t;
+            state[3][lane] = rotl(state[3][lane], 45);
+        }
+    }
+
+    __attribute__((target("avx2"))) static __m256i rotl_avx2(__m256i x, int k)
+    {
+        return _mm256_or_si256(_mm256_slli_epi64(x, k), _mm256_srli_epi64(x, 64 - k));
+    }
+
+    /* Заполняет целые группы, возвращает число заполненных элементов */
+    __attribute__((target("avx2"))) size_t fill_avx2(uint64_t *out, size_t count)
+    {
+        __m256i s0 = _mm256_load_si256(reinterpret_cast<const __m256i *>(state[0]));
+        __m256i s1 = _mm256_load_si256(reinterpret_cast<const __m256i *>(state[1]));
+        __m256i s2 = _mm256_load_si256(reinterpret_cast<const __m256i *>(state[2]));
+        __m256i s3 = _mm256_load_si256(reinterpret_cast<const __m256i *>(state[3]));
+        size_t i = 0;
+        for (; i + LANES <= count; i += LANES)
+        {
+            // Умножения на 5 и 9 - сдвиг и сложение: в AVX2 нет 64-битного умножения
+            __m256i times5 = _mm256_add_epi64(_mm256_slli_epi64(s1, 2), s1);
+            __m256i rotated = rotl_avx2(times5, 7);
+            __m256i result = _mm256_add_epi64(_mm256_slli_epi64(rotated, 3), rotated);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), result);
+            __m256i t = _mm256_slli_epi64(s1, 17);
+            s2 = _mm256_xor_si256(s2, s0);
+            s3 = _mm256_xor_si256(s3, s1);
+            s1 = _mm256_xor_si256(s1, s2);
+            s0 = _mm256_xor_si256(s0, s3);
+            s2 = _mm256_xor_si256(s2, t);
+            s3 = rotl_avx2(s3, 45);
+        }
+        _mm256_store_si256(reinterpret_cast<__m256i *>(state[0]), s0);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(state[1]), s1);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(state[2]), s2);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(state[3]), s3);
+        return i;
+    }
+
+    alignas(32) uint64_t state[4][LANES];
+};
+
+#endif
@@ -0,0 +1,780 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "../fast_random.h"
+#include "dir_reader.h"
+
+using namespace std;
+using namespace std::chrono;
+
+#define err_exit(code, str)                            \
+    {                                                  \
+        cerr << str << ": " << strerror(code) << endl; \
+        exit(EXIT_FAILURE);                            \
+    }
+
+/*
+Synthetic directory tree generator and end-to-end benchmark of main1/main2 on it.
+generate builds a tree reproducible from the seed: depth, fanout, file count, size
+distribution (fixed, uniform, heavy-tailed Pareto), share of files containing the
+needle and share of "noise" - non-.txt files (logs, files without an extension,
+binaries). run starts the search programs on the same tree and prints CSV: files/s,
+MB/s, peak RSS of the child and speedup relative to the first thread count in the
+list. walk compares a single-threaded tree walk with readdir + stat against
+getdents64 + d_type by time and number of system calls.
+daemon compares the query latency of a resident search_daemon (the first query,
+which fills its caches, and the following ones) with a full command-line run and
+prints p50/p99
+*/
+
+enum SizeDistribution
+{
+    SIZE_FIXED,
+    SIZE_UNIFORM,
+    SIZE_PARETO
+};
+
+struct CorpusConfig
+{
+    int depth = 3;                          // Subdirectory levels under the root
+    int fanout = 4;                         // Subdirectories in each directory
+    long files = 10000;                     // Total files in the tree
+    long size_mean = 16384;                 // Mean file size in bytes
+    SizeDistribution distribution = SIZE_FIXED;
+    double alpha = 1.5;                     // Pareto exponent: the smaller, the heavier the tail
+    long max_size = 64L << 20;              // Size cap for a single file
+    double hit_rate = 0.01;                 // Share of files containing the needle
+    double noise = 0.1;                     // Share of non-.txt files
+    uint64_t seed = 42;
+};
+
+struct RunConfig
+{
+    vector<string> programs = {"./main1", "./main2"};
+    vector<int> threads = {1, 2, 4};
+    int runs = 3;             // Runs per configuration, the median is printed
+    int warmup = 1;           // Warm-up runs that fill the page cache
+    bool drop_caches = false; // Drop the page cache before every run (needs root)
+    int timeout = 600;        // Seconds per run before the program is killed
+    string daemon = "./search_daemon";
+    long cache_mb = 0;        // Daemon content cache, 0 - directory listings only
+};
+
+const char *WORDS[] = {"alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+                       "india", "juliet", "kilo", "lima", "mike", "november", "oscar", "papa",
+                       "quebec", "romeo", "sierra", "tango", "uniform", "victor", "whiskey", "yankee"};
+const size_t TEXT_POOL_SIZE = 1 << 20; // Shared text that files are cut from
+
+/* Lines of dictionary words; the needle never occurs in it */
+string make_text_pool(Xoshiro256 &random)
+{
+    string pool;
+    pool.reserve(TEXT_POOL_SIZE + 128);
+    int words_in_line = 0;
+    while (pool.size() < TEXT_POOL_SIZE)
+    {
+        pool += WORDS[random.next_below(sizeof(WORDS) / sizeof(WORDS[0]))];
+        if (++words_in_line == 12)
+        {
+            pool += '\n';
+            words_in_line = 0;
+        }
+        else
+            pool += ' ';
+    }
+    pool.resize(TEXT_POOL_SIZE);
+    return pool;
+}
+
+long draw_size(const CorpusConfig &config, Xoshiro256 &random)
+{
+    double size = config.size_mean;
+    if (config.distribution == SIZE_UNIFORM)
+        size = random.next_double() * 2 * config.size_mean;
+    else if (config.distribution == SIZE_PARETO)
+    {
+        // The minimum is chosen so that the distribution mean equals size_mean
+        double minimum = config.size_mean * (config.alpha - 1) / config.alpha;
+        size = minimum / pow(1.0 - random.next_double(), 1.0 / config.alpha);
+    }
+    return min<long>(config.max_size, (long)size);
+}
+
+void write_file(const string &path, const char *data, size_t size)
+{
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        err_exit(errno, "Cannot create " + path);
+    while (size > 0)
+    {
+        ssize_t written = write(fd, data, size);
+        if (written < 0)
+            err_exit(errno, "Cannot write " + path);
+        data += written;
+        size -= written;
+    }
+    close(fd);
+}
+
+/* Creates the tree's directories in breadth-first order and returns their paths */
+vector<string> make_directories(const string &root, const CorpusConfig &config)
+{
+    vector<string> directories = {root};
+    if (mkdir(root.c_str(), 0755) != 0 && errno != EEXIST)
+        err_exit(errno, "Cannot create " + root);
+    size_t level_begin = 0;
+    for (int level = 0; level < config.depth; ++level)
+    {
+        size_t level_end = directories.size();
+        for (size_t parent = level_begin; parent < level_end; ++parent)
+        {
+            for (int child = 0; child < config.fanout; ++child)
+            {
+                char name[32];
+                snprintf(name, sizeof(name), "/d%02d", child);
+                string path = directories[parent] + name;
+                if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST)
+                    err_exit(errno, "Cannot create " + path);
+                directories.push_back(path);
+            }
+        }
+        level_begin = level_end;
+    }
+    return directories;
+}
+
+void generate_corpus(const string &root, const CorpusConfig &config, const string &needle)
+{
+    Xoshiro256 random(config.seed);
+    string pool = make_text_pool(random);
+    vector<string> directories = make_directories(root, config);
+    vector<char> content;
+    long hit_files = 0, noise_files = 0;
+    long long total_bytes = 0, largest = 0;
+    for (long i = 0; i < config.files; ++i)
+    {
+        const string &directory = directories[random.next_below(directories.size())];
+        long size = draw_size(config, random);
+        bool noise = random.next_double() < config.noise;
+        bool binary = false;
+        char name[32];
+        if (noise)
+        {
+            // Noise split evenly: logs, files without an extension and binaries
+            int kind = random.next_below(3);
+            binary = kind == 2;
+            snprintf(name, sizeof(name), kind == 0 ? "/f%07ld.log" : kind == 1 ? "/f%07ld" : "/f%07ld.bin", i);
+            ++noise_files;
+        }
+        else
+            snprintf(name, sizeof(name), "/f%07ld.txt", i);
+        content.resize(size);
+        if (binary)
+        {
+            for (long j = 0; j < size; ++j)
+                content[j] = (char)random.next_below(256);
+        }
+        else
+        {
+            // A slice of the shared text from a random offset, wrapping around
+            size_t offset = random.next_below(TEXT_POOL_SIZE);
+            for (long j = 0; j < size;)
+            {
+                size_t part = min<size_t>(size - j, TEXT_POOL_SIZE - offset);
+                memcpy(content.data() + j, pool.data() + offset, part);
+                j += part;
+                offset = 0;
+            }
+        }
+        if (!binary && size >= (long)needle.size() && random.next_double() < config.hit_rate)
+        {
+            size_t position = random.next_below(size - needle.size() + 1);
+            memcpy(content.data() + position, needle.data(), needle.size());
+            ++hit_files;
+        }
+        write_file(directory + name, content.data(), size);
+        total_bytes += size;
+        largest = max<long long>(largest, size);
+    }
+    cerr << "Generated " << directories.size() << " directories, " << config.files << " files ("
+         << noise_files << " noise, " << hit_files << " with '" << needle << "'), "
+         << total_bytes / 1e6 << " MB, largest file " << largest / 1e6 << " MB" << endl;
+}
+
+/* Tree statistics for converting time into files/s and MB/s */
+struct CorpusStats
+{
+    long files = 0;
+    long txt_files = 0;
+    long long bytes = 0;
+    long long txt_bytes = 0;
+};
+
+CorpusStats corpus_stats;
+
+int count_entry(const char *path, const struct stat *info, int type, struct FTW *)
+{
+    if (type != FTW_F)
+        return 0;
+    size_t length = strlen(path);
+    bool txt = length > 4 && strcmp(path + length - 4, ".txt") == 0;
+    ++corpus_stats.files;
+    corpus_stats.bytes += info->st_size;
+    if (txt)
+    {
+        ++corpus_stats.txt_files;
+        corpus_stats.txt_bytes += info->st_size;
+    }
+    return 0;
+}
+
+/* Result of one search program run */
+struct RunResult
+{
+    double seconds;
+    long peak_rss_kb; // ru_maxrss of the child
+    long lines;       // Output lines, i.e. matches found
+};
+
+/*
+Command-line arguments: main1 takes the directory first, main2 last.
+By default main1 reads every text file and main2 only .txt, so main1 is limited
+to the same .txt files and both programs are compared on the same set
+*/
+vector<string> search_arguments(const string &program, const string &root, const string &needle, int threads)
+{
+    if (program.find("main1") != string::npos)
+        return {program, "-i", "*.txt", root, needle, to_string(threads)};
+    return {program, needle, to_string(threads), root};
+}
+
+void drop_page_cache()
+{
+    sync();
+    int fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+    if (fd < 0 || write(fd, "3", 1) != 1)
+        cerr << "Cannot drop page cache: " << strerror(errno) << endl;
+    if (fd >= 0)
+        close(fd);
+}
+
+RunResult run_search(const vector<string> &arguments, int timeout)
+{
+    int output[2];
+    if (pipe(output) != 0)
+        err_exit(errno, "Cannot create pipe");
+    auto start = steady_clock::now();
+    pid_t child = fork();
+    if (child < 0)
+        err_exit(errno, "Cannot fork");
+    if (child == 0)
+    {
+        dup2(output[1], STDOUT_FILENO);
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDERR_FILENO);
+        close(output[0]);
+        close(output[1]);
+        vector<char *> argv;
+        for (const auto &argument : arguments)
+            argv.push_back(const_cast<char *>(argument.c_str()));
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    close(output[1]);
+    // Read output right away, otherwise the program blocks on a full pipe
+    RunResult result = {0, 0, 0};
+    char buffer[65536];
+    auto deadline = start + seconds(timeout);
+    while (true)
+    {
+        pollfd ready = {output[0], POLLIN, 0};
+        int left_ms = duration_cast<milliseconds>(deadline - steady_clock::now()).count();
+        if (left_ms <= 0 || poll(&ready, 1, left_ms) == 0)
+        {
+            // A hung program must not stall the whole benchmark
+            cerr << arguments[0] << " timed out after " << timeout << "s" << endl;
+            kill(child, SIGKILL);
+            break;
+        }
+        ssize_t count = read(output[0], buffer, sizeof(buffer));
+        if (count <= 0)
+            break;
+        result.lines += count_if(buffer, buffer + count, [](char c) { return c == '\n'; });
+    }
+    close(output[0]);
+    int status;
+    rusage usage;
+    if (wait4(child, &status, 0, &usage) < 0)
+        err_exit(errno, "Cannot wait for " + arguments[0]);
+    result.seconds = duration<double>(steady_clock::now() - start).count();
+    result.peak_rss_kb = usage.ru_maxrss;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) == 127)
+        cerr << arguments[0] << " failed with status " << status << endl;
+    return result;
+}
+
+void run_benchmark(const string &root, const RunConfig &config, const string &needle)
+{
+    if (nftw(root.c_str(), count_entry, 64, FTW_PHYS) != 0)
+        err_exit(errno, "Cannot walk " + root);
+    cout << "program,threads,runs,files,txt_files,txt_mb,median_s,files_per_s,mb_per_s,peak_rss_kb,speedup,matches"
+         << endl;
+    cout << fixed;
+    for (const string &program : config.programs)
+    {
+        double baseline = 0; // Median at the first thread count in the list
+        for (int threads : config.threads)
+        {
+            vector<string> arguments = search_arguments(program, root, needle, threads);
+            for (int i = 0; i < config.warmup && !config.drop_caches; ++i)
+                run_search(arguments, config.timeout);
+            vector<double> times;
+            long peak_rss = 0, matches = 0;
+            for (int i = 0; i < config.runs; ++i)
+            {
+                if (config.drop_caches)
+                    drop_page_cache();
+                RunResult result = run_search(arguments, config.timeout);
+                times.push_back(result.seconds);
+                peak_rss = max(peak_rss, result.peak_rss_kb);
+                matches = result.lines;
+            }
+            sort(times.begin(), times.end());
+            double median = times[times.size() / 2];
+            if (baseline == 0)
+                baseline = median;
+            // Both programs read only .txt (see search_arguments), so MB/s is based on those
+            cout << program << "," << threads << "," << config.runs << "," << corpus_stats.files << ","
+                 << corpus_stats.txt_files << "," << setprecision(3) << corpus_stats.txt_bytes / 1e6 << ","
+                 << setprecision(6) << median << "," << setprecision(0) << corpus_stats.files / median << ","
+                 << setprecision(2) << corpus_stats.txt_bytes / 1e6 / median << "," << peak_rss << ","
+                 << baseline / median << "," << matches << endl;
+        }
+    }
+}
+
+/* Nearest-rank percentile of sorted samples */
+double percentile(const vector<double> &sorted, double share)
+{
+    size_t rank = (size_t)ceil(share * sorted.size());
+    return sorted[min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+void print_latency(const string &mode, int threads, vector<double> times, long matches)
+{
+    sort(times.begin(), times.end());
+    double mean = 0;
+    for (double time : times)
+        mean += time / times.size();
+    cout << mode << "," << threads << "," << times.size() << "," << setprecision(3) << percentile(times, 0.5) * 1e3
+         << "," << percentile(times, 0.99) * 1e3 << "," << mean * 1e3 << "," << matches << endl;
+}
+
+int connect_daemon(const string &socket_path)
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, (sockaddr *)&address, sizeof(address)) != 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+/* One daemon query, from connecting until the daemon closes the connection */
+RunResult query_daemon(const string &socket_path, const string &root, const string &needle)
+{
+    RunResult result = {0, 0, 0};
+    auto start = steady_clock::now();
+    int fd = connect_daemon(socket_path);
+    if (fd < 0)
+        err_exit(errno, "Cannot connect to " + socket_path);
+    string request = root + "\t" + needle + "\t0\t0\n";
+    if (write(fd, request.data(), request.size()) != (ssize_t)request.size())
+        err_exit(errno, "Cannot send request");
+    char buffer[65536];
+    ssize_t count;
+    while ((count = read(fd, buffer, sizeof(buffer))) > 0)
+        result.lines += count_if(buffer, buffer + count, [](char c) { return c == '\n'; });
+    close(fd);
+    result.seconds = duration<double>(steady_clock::now() - start).count();
+    return result;
+}
+
+/*
+Query latency: every program from --programs is started anew for each query, as
+the tools do today, while the daemon is started once with the first thread count
+from --threads. The first daemon query is reported separately: it reads the
+directories from disk and sets up the inotify watches
+*/
+void daemon_benchmark(const string &root, const RunConfig &config, const string &needle)
+{
+    int threads = config.threads.front();
+    cout << "mode,threads,queries,p50_ms,p99_ms,mean_ms,matches" << endl;
+    cout << fixed;
+    for (const string &program : config.programs)
+    {
+        vector<string> arguments = search_arguments(program, root, needle, threads);
+        for (int i = 0; i < config.warmup && !config.drop_caches; ++i)
+            run_search(arguments, config.timeout);
+        vector<double> times;
+        long matches = 0;
+        for (int i = 0; i < config.runs; ++i)
+        {
+            if (config.drop_caches)
+                drop_page_cache();
+            RunResult result = run_search(arguments, config.timeout);
+            times.push_back(result.seconds);
+            matches = result.lines;
+        }
+        print_latency("cli:" + program, threads, times, matches);
+    }
+    string socket_path = "/tmp/bench_search_" + to_string(getpid()) + ".sock";
+    pid_t daemon = fork();
+    if (daemon < 0)
+        err_exit(errno, "Cannot fork");
+    if (daemon == 0)
+    {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDERR_FILENO);
+        string threads_text = to_string(threads), cache_text = to_string(config.cache_mb);
+        execl(config.daemon.c_str(), config.daemon.c_str(), "serve", socket_path.c_str(), "-t", threads_text.c_str(),
+              "-c", cache_text.c_str(), "-i", "*.txt", (char *)NULL);
+        _exit(127);
+    }
+    // The daemon is ready once it accepts connections
+    int probe = -1;
+    for (int i = 0; i < 500 && probe < 0 && waitpid(daemon, NULL, WNOHANG) == 0; ++i)
+    {
+        probe = connect_daemon(socket_path);
+        if (probe < 0)
+            usleep(10000);
+    }
+    if (probe < 0)
+    {
+        cerr << "Cannot start " << config.daemon << endl;
+        kill(daemon, SIGKILL);
+        waitpid(daemon, NULL, 0);
+        exit(EXIT_FAILURE);
+    }
+    close(probe);
+    if (config.drop_caches)
+        drop_page_cache();
+    RunResult first = query_daemon(socket_path, root, needle);
+    print_latency("daemon_first", threads, {first.seconds}, first.lines);
+    vector<double> times;
+    long matches = 0;
+    for (int i = 0; i < config.runs; ++i)
+    {
+        if (config.drop_caches)
+            drop_page_cache();
+        RunResult result = query_daemon(socket_path, root, needle);
+        times.push_back(result.seconds);
+        matches = result.lines;
+    }
+    print_latency("daemon_warm", threads, times, matches);
+    kill(daemon, SIGTERM);
+    waitpid(daemon, NULL, 0);
+}
+
+/* Walk totals: entries and directories seen */
+struct WalkCount
+{
+    long entries = 0;
+    long directories = 0;
+};
+
+/* Walk as main1/main2 used to do it: readdir and stat on every entry */
+void walk_readdir_stat(const string &directory, WalkCount &count)
+{
+    DIR *dir = opendir(directory.c_str());
+    if (!dir)
+        return;
+    ++count.directories;
+    dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        ++count.entries;
+        string path = directory + "/" + entry->d_name;
+        struct stat info;
+        if (stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode))
+            walk_readdir_stat(path, count);
+    }
+    closedir(dir);
+}
+
+/* Walk through dir_reader with one buffer for the whole walk */
+void walk_getdents(const string &directory, dir_reader &reader, WalkCount &count)
+{
+    if (dir_reader_open(&reader, directory.c_str()) != 0)
+        return;
+    ++count.directories;
+    vector<string> subdirectories;
+    const char *name;
+    unsigned char type;
+    while (dir_reader_next(&reader, &name, &type) > 0)
+    {
+        ++count.entries;
+        if (type == DT_DIR)
+            subdirectories.push_back(directory + "/" + name);
+    }
+    dir_reader_close(&reader);
+    for (const auto &subdirectory : subdirectories)
+        walk_getdents(subdirectory, reader, count);
+}
+
+WalkCount walk_tree(const string &root, bool getdents)
+{
+    WalkCount count;
+    if (getdents)
+    {
+        dir_reader reader;
+        dir_reader_init(&reader, DIR_READER_BUFFER_SIZE);
+        walk_getdents(root, reader, count);
+        dir_reader_destroy(&reader);
+    }
+    else
+        walk_readdir_stat(root, count);
+    return count;
+}
+
+/* System calls of one walk */
+struct SyscallCount
+{
+    long getdents = 0;
+    long stats = 0; // stat, lstat, newfstatat, statx
+    long total = 0;
+};
+
+bool is_stat_syscall(long number)
+{
+#ifdef SYS_stat
+    if (number == SYS_stat || number == SYS_lstat)
+        return true;
+#endif
+#ifdef SYS_statx
+    if (number == SYS_statx)
+        return true;
+#endif
+    return number == SYS_newfstatat;
+}
+
+/*
+Counts the system calls of a walk: the walk runs in a child under ptrace, and the
+parent stops it on entry to every call. Tracing slows the walk down by orders of
+magnitude, so timing is measured by separate untraced runs
+*/
+SyscallCount count_syscalls(const string &root, bool getdents)
+{
+    SyscallCount count;
+    pid_t child = fork();
+    if (child < 0)
+        err_exit(errno, "Cannot fork");
+    if (child == 0)
+    {
+        if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) != 0)
+            _exit(1);
+        raise(SIGSTOP);
+        walk_tree(root, getdents);
+        _exit(0);
+    }
+    int status;
+    waitpid(child, &status, 0);
+    if (!WIFSTOPPED(status) || ptrace(PTRACE_SETOPTIONS, child, NULL, PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL) != 0)
+    {
+        cerr << "Cannot trace the walker, syscall counts are not available" << endl;
+        kill(child, SIGKILL);
+        waitpid(child, &status, 0);
+        return {-1, -1, -1};
+    }
+    while (ptrace(PTRACE_SYSCALL, child, NULL, NULL) == 0 && waitpid(child, &status, 0) == child)
+    {
+        if (WIFEXITED(status) || WIFSIGNALED(status))
+            break;
+        if (!WIFSTOPPED(status) || WSTOPSIG(status) != (SIGTRAP | 0x80))
+            continue;
+        __ptrace_syscall_info info;
+        if (ptrace(PTRACE_GET_SYSCALL_INFO, child, sizeof(info), &info) <= 0 || info.op != PTRACE_SYSCALL_INFO_ENTRY)
+            continue;
+        long number = info.entry.nr;
+        ++count.total;
+        if (number == SYS_getdents64)
+            ++count.getdents;
+        else if (is_stat_syscall(number))
+            ++count.stats;
+    }
+    return count;
+}
+
+void walk_benchmark(const string &root, int runs)
+{
+    cout << "walker,entries,directories,runs,median_s,entries_per_s,getdents64_calls,stat_calls,total_syscalls" << endl;
+    cout << fixed;
+    for (bool getdents : {false, true})
+    {
+        vector<double> times;
+        WalkCount count;
+        for (int i = 0; i < runs; ++i)
+        {
+            auto start = steady_clock::now();
+            count = walk_tree(root, getdents);
+            times.push_back(duration<double>(steady_clock::now() - start).count());
+        }
+        sort(times.begin(), times.end());
+        double median = times[times.size() / 2];
+        SyscallCount syscalls = count_syscalls(root, getdents);
+        cout << (getdents ? "getdents64_dtype" : "readdir_stat") << "," << count.entries << "," << count.directories
+             << "," << runs << "," << setprecision(6) << median << "," << setprecision(0) << count.entries / median
+             << "," << syscalls.getdents << "," << syscalls.stats << "," << syscalls.total << endl;
+    }
+}
+
+vector<string> split_list(const string &text)
+{
+    vector<string> items;
+    size_t start = 0;
+    while (start <= text.size())
+    {
+        size_t end = text.find(',', start);
+        if (end == string::npos)
+            end = text.size();
+        if (end > start)
+            items.push_back(text.substr(start, end - start));
+        start = end + 1;
+    }
+    return items;
+}
+
+void print_usage(const char *program)
+{
+    cerr << "Usage: " << program << " generate|run|all|walk|daemon <directory> [options]\n"
+         << "generate: [--depth N] [--fanout N] [--files N] [--size-mean bytes] [--size-dist fixed|uniform|pareto]\n"
+         << "          [--alpha a] [--max-size bytes] [--hit-rate f] [--noise f] [--seed n]\n"
+         << "run:      [--programs ./main1,./main2] [--threads 1,2,4] [--runs N] [--warmup N] [--timeout s]\n"
+         << "          [--drop-caches]\n"
+         << "walk:     [--runs N]  readdir + stat against getdents64 + d_type\n"
+         << "daemon:   [--daemon ./search_daemon] [--cache-mb N] [--programs ./main1] [--threads N] [--runs N]\n"
+         << "          [--warmup N] [--drop-caches]  query latency of the daemon against CLI runs\n"
+         << "both:     [--needle text]" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    string mode = argv[1];
+    string root = argv[2];
+    string needle = "xyzzy_needle";
+    CorpusConfig corpus;
+    RunConfig run;
+    for (int i = 3; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--drop-caches")
+        {
+            run.drop_caches = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        string value = argv[++i];
+        if (arg == "--depth")
+            corpus.depth = atoi(value.c_str());
+        else if (arg == "--fanout")
+            corpus.fanout = atoi(value.c_str());
+        else if (arg == "--files")
+            corpus.files = atol(value.c_str());
+        else if (arg == "--size-mean")
+            corpus.size_mean = atol(value.c_str());
+        else if (arg == "--size-dist")
+            corpus.distribution = value == "pareto" ? SIZE_PARETO : value == "uniform" ? SIZE_UNIFORM : SIZE_FIXED;
+        else if (arg == "--alpha")
+            corpus.alpha = max(1.01, atof(value.c_str()));
+        else if (arg == "--max-size")
+            corpus.max_size = atol(value.c_str());
+        else if (arg == "--hit-rate")
+            corpus.hit_rate = atof(value.c_str());
+        else if (arg == "--noise")
+            corpus.noise = atof(value.c_str());
+        else if (arg == "--seed")
+            corpus.seed = strtoull(value.c_str(), NULL, 10);
+        else if (arg == "--needle")
+            needle = value;
+        else if (arg == "--programs")
+            run.programs = split_list(value);
+        else if (arg == "--threads")
+        {
+            run.threads.clear();
+            for (const auto &item : split_list(value))
+                run.threads.push_back(max(1, atoi(item.c_str())));
+        }
+        else if (arg == "--runs")
+            run.runs = max(1, atoi(value.c_str()));
+        else if (arg == "--warmup")
+            run.warmup = atoi(value.c_str());
+        else if (arg == "--timeout")
+            run.timeout = max(1, atoi(value.c_str()));
+        else if (arg == "--daemon")
+            run.daemon = value;
+        else if (arg == "--cache-mb")
+            run.cache_mb = max(0L, atol(value.c_str()));
+        else
+        {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (mode == "walk")
+    {
+        walk_benchmark(root, run.runs);
+        return 0;
+    }
+    if (mode == "daemon")
+    {
+        daemon_benchmark(root, run, needle);
+        return 0;
+    }
+    if (mode != "generate" && mode != "run" && mode != "all")
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (mode != "run")
+        generate_corpus(root, corpus, needle);
+    if (mode != "generate")
+        run_benchmark(root, run, needle);
+    return 0;
+}
@@ -0,0 +1,50 @@
+#ifndef CANCEL_TOKEN_H
+#define CANCEL_TOKEN_H
+
+/*
+Shared early-exit flag for a search and the match counter for -m N. The flag is
+checked by the directory walk (between entries), the task queue (on dequeue) and
+the scanners (between blocks or lines of a file), so once the goal is reached every
+thread stops within one block, and tasks left in the queue are dropped without
+touching the disk.
+GCC atomic builtins work in both C and C++
+*/
+typedef struct
+{
+    int cancelled;    // Non-zero - the search must stop
+    long matches;     // Matches already allowed to be printed
+    long max_matches; // Match limit, 0 - unlimited
+} cancel_token;
+
+static inline void cancel_token_init(cancel_token *token, long max_matches)
+{
+    token->cancelled = 0;
+    token->matches = 0;
+    token->max_matches = max_matches;
+}
+
+static inline int cancel_requested(const cancel_token *token)
+{
+    return __atomic_load_n(&token->cancelled, __ATOMIC_ACQUIRE);
+}
+
+static inline void cancel_request(cancel_token *token)
+{
+    __atomic_store_n(&token->cancelled, 1, __ATOMIC_RELEASE);
+}
+
+/*
+Claims a slot for the next match: 1 - it may be printed, 0 - the limit is already
+used up. The match that takes the last slot sets the cancel flag
+*/
+static inline int cancel_claim_match(cancel_token *token)
+{
+    if (token->max_matches == 0)
+        return 1;
+    long number = __atomic_add_fetch(&token->matches, 1, __ATOMIC_ACQ_REL);
+    if (number >= token->max_matches)
+        cancel_request(token);
+    return number <= token->max_matches;
+}
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef DIR_READER_H
+#define DIR_READER_H
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+/*
+Batched directory reading with getdents64 into a large reusable buffer.
+glibc's readdir reads 32 KiB at a time, and the walkers called stat on every entry
+just to learn its type, so huge flat directories were bound by system calls.
+Here the type comes from d_type, which almost every file system fills in; only
+when it is unknown (DT_UNKNOWN) or the entry is a symlink is statx called with
+the minimal STATX_TYPE mask. Symlinks are followed, as stat did.
+One buffer is allocated per thread and reused for all of its directories
+*/
+
+#define DIR_READER_BUFFER_SIZE (1 << 20)
+
+/* Entry in the kernel's format (glibc does not declare it) */
+struct linux_dirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+typedef struct
+{
+    int fd;             // Open directory, -1 when closed
+    char *buffer;       // getdents64 buffer, survives closing the directory
+    size_t buffer_size;
+    long position;      // Offset of the next entry in the buffer
+    long end;           // Bytes returned by the last getdents64
+} dir_reader;
+
+static inline void dir_reader_init(dir_reader *reader, size_t buffer_size)
+{
+    reader->fd = -1;
+    reader->buffer = (char *)malloc(buffer_size);
+    reader->buffer_size = buffer_size;
+    reader->position = reader->end = 0;
+}
+
+static inline void dir_reader_destroy(dir_reader *reader)
+{
+    if (reader->fd >= 0)
+        close(reader->fd);
+    free(reader->buffer);
+    reader->buffer = NULL;
+}
+
+/* 0 on success, -1 with errno on error */
+static inline int dir_reader_open(dir_reader *reader, const char *path)
+{
+    reader->fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    reader->position = reader->end = 0;
+    return reader->fd < 0 ? -1 : 0;
+}
+
+static inline void dir_reader_close(dir_reader *reader)
+{
+    if (reader->fd >= 0)
+        close(reader->fd);
+    reader->fd = -1;
+}
+
+/* Entry type via statx relative to the open directory; DT_UNKNOWN if the file is gone */
+static inline unsigned char dir_reader_resolve_type(dir_reader *reader, const char *name)
+{
+    mode_t mode;
+#ifdef STATX_TYPE
+    struct statx info;
+    if (statx(reader->fd, name, 0, STATX_TYPE, &info) == 0)
+        mode = info.stx_mode;
+    else
+#endif
+    {
+        // Kernels before 4.11 have no statx
+        struct stat st;
+        if (fstatat(reader->fd, name, &st, 0) != 0)
+            return DT_UNKNOWN;
+        mode = st.st_mode;
+    }
+    if (S_ISDIR(mode))
+        return DT_DIR;
+    if (S_ISREG(mode))
+        return DT_REG;
+    return DT_UNKNOWN;
+}
+
+/*
+Size of file name in the open directory, -1 if it is inaccessible. Uses statx
+with STATX_SIZE; only needed for files that will actually be read
+*/
+static inline long long dir_reader_file_size(dir_reader *reader, const char *name)
+{
+#ifdef STATX_SIZE
+    struct statx info;
+    if (statx(reader->fd, name, 0, STATX_SIZE, &info) == 0)
+        return info.stx_size;
+#endif
+    struct stat st;
+    if (fstatat(reader->fd, name, &st, 0) != 0)
+        return -1;
+    return st.st_size;
+}
+
+/*
+Next directory entry, skipping "." and "..": 1 - entry in *name and *type (DT_DIR,
+DT_REG, DT_UNKNOWN for anything else or inaccessible), 0 - end of directory, -1 - error.
+*name points into the buffer and stays valid until the next call
+*/
+static inline int dir_reader_next(dir_reader *reader, const char **name, unsigned char *type)
+{
+    while (1)
+    {
+        if (reader->position >= reader->end)
+        {
+            long count = syscall(SYS_getdents64, reader->fd, reader->buffer, reader->buffer_size);
+            if (count <= 0)
+                return count < 0 ? -1 : 0;
+            reader->position = 0;
+            reader->end = count;
+        }
+        struct linux_dirent64 *entry = (struct linux_dirent64 *)(reader->buffer + reader->position);
+        reader->position += entry->d_reclen;
+        if (entry->d_name[0] == '.' &&
+            (entry->d_name[1] == 0 || (entry->d_name[1] == '.' && entry->d_name[2] == 0)))
+            continue;
+        *name = entry->d_name;
+        if (entry->d_type == DT_DIR || entry->d_type == DT_REG)
+            *type = entry->d_type;
+        else if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK)
+            *type = dir_reader_resolve_type(reader, entry->d_name);
+        else
+            *type = DT_UNKNOWN;
+        return 1;
+    }
+}
+
+#endif
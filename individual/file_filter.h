@@ -0,0 +1,234 @@
+#ifndef FILE_FILTER_H
+#define FILE_FILTER_H
+
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/*
+File selection for the search scanners. The name is checked against include and
+exclude globs first (-i/-x, like grep's --include/--exclude), then only the first
+SNIFF_SIZE block of an accepted file is read: a file with a NUL byte or a noticeable
+share of control characters is treated as binary and not read any further.
+Globs are compiled once while parsing arguments: the common "*.ext" form becomes
+a name suffix compare, the rest (*, ?, [a-z], [!a-z]) are matched iteratively
+without recursion. The AVX2 block check handles 32 bytes per instruction and is
+selected at run time
+*/
+
+#define SNIFF_SIZE 4096
+#define BINARY_CONTROL_SHARE 16 // Binary if control characters exceed 1/16 of the block
+
+typedef struct
+{
+    char **suffixes; // "*.ext" globs, stored as ".ext"
+    size_t *suffix_lengths;
+    size_t suffix_count;
+    char **patterns; // All other globs
+    size_t pattern_count;
+} glob_set;
+
+typedef struct
+{
+    glob_set include; // Empty set - every name is accepted
+    glob_set exclude;
+    int scan_binary;  // Do not skip binary files
+} file_filter;
+
+static inline void glob_set_init(glob_set *set)
+{
+    memset(set, 0, sizeof(*set));
+}
+
+static inline void glob_set_add(glob_set *set, const char *pattern)
+{
+    // "*.ext" without other metacharacters - a suffix compare
+    if (pattern[0] == '*' && pattern[1] != 0 && strpbrk(pattern + 1, "*?[") == NULL)
+    {
+        set->suffixes = (char **)realloc(set->suffixes, (set->suffix_count + 1) * sizeof(char *));
+        set->suffix_lengths = (size_t *)realloc(set->suffix_lengths, (set->suffix_count + 1) * sizeof(size_t));
+        set->suffixes[set->suffix_count] = strdup(pattern + 1);
+        set->suffix_lengths[set->suffix_count] = strlen(pattern + 1);
+        set->suffix_count++;
+        return;
+    }
+    set->patterns = (char **)realloc(set->patterns, (set->pattern_count + 1) * sizeof(char *));
+    set->patterns[set->pattern_count++] = strdup(pattern);
+}
+
+static inline void glob_set_destroy(glob_set *set)
+{
+    for (size_t i = 0; i < set->suffix_count; i++)
+        free(set->suffixes[i]);
+    for (size_t i = 0; i < set->pattern_count; i++)
+        free(set->patterns[i]);
+    free(set->suffixes);
+    free(set->suffix_lengths);
+    free(set->patterns);
+    glob_set_init(set);
+}
+
+/* Matches class [...] against c; *pattern is advanced past the class */
+static inline int glob_match_class(const char **pattern, unsigned char c)
+{
+    const char *p = *pattern + 1;
+    int negate = *p == '!' || *p == '^';
+    if (negate)
+        p++;
+    int matched = 0;
+    // A ']' right after '[' is an ordinary character
+    do
+    {
+        unsigned char low = *p++;
+        unsigned char high = low;
+        if (*p == '-' && p[1] != ']' && p[1] != 0)
+        {
+            high = p[1];
+            p += 2;
+        }
+        if (low <= c && c <= high)
+            matched = 1;
+    } while (*p != ']' && *p != 0);
+    *pattern = *p == ']' ? p + 1 : p;
+    return matched != negate;
+}
+
+/* Glob against the whole name; on mismatch backtracks only to the last '*' */
+static inline int glob_match(const char *pattern, const char *name)
+{
+    const char *star = NULL;
+    const char *star_name = NULL;
+    while (*name)
+    {
+        const char *next = pattern;
+        if (*pattern == '*')
+        {
+            star = ++pattern;
+            star_name = name;
+            continue;
+        }
+        if (*pattern == '[' && glob_match_class(&next, (unsigned char)*name))
+        {
+            pattern = next;
+            name++;
+            continue;
+        }
+        if (*pattern != '[' && *pattern != 0 && (*pattern == '?' || *pattern == *name))
+        {
+            pattern++;
+            name++;
+            continue;
+        }
+        if (!star)
+            return 0;
+        pattern = star;
+        name = ++star_name;
+    }
+    while (*pattern == '*')
+        pattern++;
+    return *pattern == 0;
+}
+
+static inline int glob_set_matches(const glob_set *set, const char *name)
+{
+    size_t length = strlen(name);
+    for (size_t i = 0; i < set->suffix_count; i++)
+    {
+        size_t suffix_length = set->suffix_lengths[i];
+        if (length >= suffix_length && memcmp(name + length - suffix_length, set->suffixes[i], suffix_length) == 0)
+            return 1;
+    }
+    for (size_t i = 0; i < set->pattern_count; i++)
+    {
+        if (glob_match(set->patterns[i], name))
+            return 1;
+    }
+    return 0;
+}
+
+static inline void file_filter_init(file_filter *filter)
+{
+    glob_set_init(&filter->include);
+    glob_set_init(&filter->exclude);
+    filter->scan_binary = 0;
+}
+
+static inline void file_filter_destroy(file_filter *filter)
+{
+    glob_set_destroy(&filter->include);
+    glob_set_destroy(&filter->exclude);
+}
+
+/* Check by file name without the directory */
+static inline int file_filter_accepts_name(const file_filter *filter, const char *name)
+{
+    if (glob_set_matches(&filter->exclude, name))
+        return 0;
+    return filter->include.suffix_count + filter->include.pattern_count == 0 ||
+           glob_set_matches(&filter->include, name);
+}
+
+/* Control character not found in text: anything below 0x20 except \t \n \v \f \r and ESC */
+static inline int is_binary_control(unsigned char c)
+{
+    return c < 0x20 && !(c >= '\t' && c <= '\r') && c != 0x1b;
+}
+
+static inline int looks_binary_scalar(const unsigned char *block, size_t size, size_t *controls)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        if (block[i] == 0)
+            return 1;
+        *controls += is_binary_control(block[i]);
+    }
+    return 0;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/* Handles whole 32-byte chunks; returns 1 on a NUL byte, otherwise stores the bytes processed in *done */
+__attribute__((target("avx2,popcnt"))) static inline int looks_binary_avx2(const unsigned char *block, size_t size,
+                                                                           size_t *controls, size_t *done)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max_control = _mm256_set1_epi8(0x1f);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i whitespace_span = _mm256_set1_epi8('\r' - '\t');
+    const __m256i escape = _mm256_set1_epi8(0x1b);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)(block + i));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, zero)))
+            return 1;
+        // Unsigned compares via min: x <= 0x1f and (x - '\t') <= 4
+        __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(bytes, max_control), bytes);
+        __m256i shifted = _mm256_sub_epi8(bytes, tab);
+        __m256i whitespace = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, whitespace_span), shifted);
+        __m256i allowed = _mm256_or_si256(whitespace, _mm256_cmpeq_epi8(bytes, escape));
+        unsigned mask = _mm256_movemask_epi8(_mm256_andnot_si256(allowed, control));
+        *controls += __builtin_popcount(mask);
+    }
+    *done = i;
+    return 0;
+}
+#endif
+
+/* Whether a block is binary: it has a NUL byte or more than 1/BINARY_CONTROL_SHARE control characters */
+static inline int looks_binary(const char *data, size_t size)
+{
+    const unsigned char *block = (const unsigned char *)data;
+    size_t controls = 0;
+    size_t done = 0;
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2") && looks_binary_avx2(block, size, &controls, &done))
+        return 1;
+#endif
+    if (looks_binary_scalar(block + done, size - done, &controls))
+        return 1;
+    return controls * BINARY_CONTROL_SHARE > size;
+}
+
+#endif
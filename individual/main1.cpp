@@ -5,24 +5,39 @@
 #include <sys/stat.h>
 #include <pthread.h>
 #include <limits.h>
+#include <unistd.h>
+#include "dir_reader.h"
+#include "cancel_token.h"
+#include "file_filter.h"
 
-#define MAX_THREADS 4
+#define MAX_THREADS 4 // Number of threads when none is given
+#define READ_BLOCK_SIZE (1 << 20) // Files are scanned by blocks so cancellation is noticed quickly
 
 typedef struct task_node
 {
     char *path;
     int is_dir;
+    long long size; // File size for largest-first scheduling
     struct task_node *next;
 } task_node;
 
+/*
+Directories are kept in FIFO order and always go first, so discovery is never
+starved. Files wait in a max-heap by size: the largest known file starts first
+and a giant file found late does not set the makespan alone.
+*/
 typedef struct
 {
-    task_node *head;
+    task_node *head;   // Directories
     task_node *tail;
+    task_node **files; // Max-heap of files by size
+    size_t files_count;
+    size_t files_capacity;
     pthread_mutex_t mutex;
     pthread_cond_t cond;
     int active_threads;
     int shutdown;
+    cancel_token *cancel;
 } task_queue;
 
 typedef struct
@@ -30,26 +45,76 @@ typedef struct
     task_queue *queue;
     const char *substring;
     pthread_mutex_t output_mutex;
+    cancel_token cancel;
+    int files_with_matches; // -l: print only the names of matching files
+    file_filter filter;     // -i/-x globs and binary detection
 } thread_data;
 
-void queue_init(task_queue *q)
+void queue_init(task_queue *q, cancel_token *cancel)
 {
     q->head = q->tail = NULL;
+    q->files = NULL;
+    q->files_count = q->files_capacity = 0;
     pthread_mutex_init(&q->mutex, NULL);
     pthread_cond_init(&q->cond, NULL);
     q->active_threads = 0;
     q->shutdown = 0;
+    q->cancel = cancel;
 }
 
-void enqueue(task_queue *q, const char *path, int is_dir)
+void files_push(task_queue *q, task_node *node)
 {
+    if (q->files_count == q->files_capacity)
+    {
+        q->files_capacity = q->files_capacity ? 2 * q->files_capacity : 64;
+        q->files = (task_node **)realloc(q->files, q->files_capacity * sizeof(task_node *));
+    }
+    size_t i = q->files_count++;
+    while (i > 0 && q->files[(i - 1) / 2]->size < node->size)
+    {
+        q->files[i] = q->files[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    q->files[i] = node;
+}
+
+task_node *files_pop(task_queue *q)
+{
+    task_node *top = q->files[0];
+    task_node *last = q->files[--q->files_count];
+    size_t i = 0;
+    while (2 * i + 1 < q->files_count)
+    {
+        size_t child = 2 * i + 1;
+        if (child + 1 < q->files_count && q->files[child + 1]->size > q->files[child]->size)
+            child++;
+        if (q->files[child]->size <= last->size)
+            break;
+        q->files[i] = q->files[child];
+        i = child;
+    }
+    if (q->files_count > 0)
+        q->files[i] = last;
+    return top;
+}
+
+void enqueue(task_queue *q, const char *path, int is_dir, long long size)
+{
+    if (cancel_requested(q->cancel))
+        return;
+
     task_node *new_node = (task_node *)malloc(sizeof(task_node));
     new_node->path = strdup(path);
     new_node->is_dir = is_dir;
+    new_node->size = size;
     new_node->next = NULL;
 
     pthread_mutex_lock(&q->mutex);
-    if (q->tail == NULL)
+    if (!is_dir)
+    {
+        files_push(q, new_node);
+    }
+    else if (q->tail == NULL)
     {
         q->head = q->tail = new_node;
     }
@@ -65,20 +130,28 @@ void enqueue(task_queue *q, const char *path, int is_dir)
 task_node *dequeue(task_queue *q)
 {
     pthread_mutex_lock(&q->mutex);
-    while (q->head == NULL && !q->shutdown)
+    while (q->head == NULL && q->files_count == 0 && !q->shutdown)
     {
         pthread_cond_wait(&q->cond, &q->mutex);
     }
-    if (q->shutdown)
+    if (q->shutdown || cancel_requested(q->cancel))
     {
         pthread_mutex_unlock(&q->mutex);
         return NULL;
     }
-    task_node *node = q->head;
-    q->head = node->next;
-    if (q->head == NULL)
+    task_node *node;
+    if (q->head != NULL)
     {
-        q->tail = NULL;
+        node = q->head;
+        q->head = node->next;
+        if (q->head == NULL)
+        {
+            q->tail = NULL;
+        }
+    }
+    else
+    {
+        node = files_pop(q);
     }
     q->active_threads++;
     pthread_mutex_unlock(&q->mutex);
@@ -89,7 +162,7 @@ void task_complete(task_queue *q)
 {
     pthread_mutex_lock(&q->mutex);
     q->active_threads--;
-    if (q->head == NULL && q->active_threads == 0)
+    if (q->head == NULL && q->files_count == 0 && q->active_threads == 0)
     {
         q->shutdown = 1;
         pthread_cond_broadcast(&q->cond);
@@ -97,41 +170,68 @@ void task_complete(task_queue *q)
     pthread_mutex_unlock(&q->mutex);
 }
 
-void process_file(const char *path, const char *substring, pthread_mutex_t *output_mutex)
+/* Stops the search: queued tasks are dropped and waiting workers are woken up */
+void queue_cancel(task_queue *q)
+{
+    cancel_request(q->cancel);
+    pthread_mutex_lock(&q->mutex);
+    q->shutdown = 1;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+void process_file(const char *path, thread_data *data, char *block)
 {
     FILE *file = fopen(path, "r");
     if (!file)
         return;
 
-    fseek(file, 0, SEEK_END);
-    long fsize = ftell(file);
-    fseek(file, 0, SEEK_SET);
-
-    char *content = (char *)malloc(fsize + 1);
-    if (!content)
+    size_t substring_length = strlen(data->substring);
+    size_t carried = 0;
+    int found = 0;
+    int first_block = 1;
+    while (!found && !cancel_requested(&data->cancel))
     {
-        fclose(file);
-        return;
-    }
+        // Only a small first block is read until the file is known to be text
+        size_t count = fread(block + carried, 1, first_block ? SNIFF_SIZE : READ_BLOCK_SIZE, file);
+        if (count == 0)
+            break;
+        if (first_block && !data->filter.scan_binary && looks_binary(block, count))
+            break;
+        first_block = 0;
 
-    fread(content, 1, fsize, file);
-    content[fsize] = 0;
+        // memmem rather than strstr: a NUL byte (binary files under -a) must not end the search
+        size_t size = carried + count;
+        found = memmem(block, size, data->substring, substring_length) != NULL;
 
-    if (strstr(content, substring))
-    {
-        pthread_mutex_lock(output_mutex);
-        printf("Found '%s' in: %s\n", substring, path);
-        pthread_mutex_unlock(output_mutex);
+        // The tail of the block is kept so a match across the block boundary is not lost
+        carried = substring_length > 0 ? substring_length - 1 : 0;
+        if (carried > size)
+            carried = size;
+        memmove(block, block + size - carried, carried);
     }
-
-    free(content);
     fclose(file);
+
+    if (found && cancel_claim_match(&data->cancel))
+    {
+        pthread_mutex_lock(&data->output_mutex);
+        if (data->files_with_matches)
+            printf("%s\n", path);
+        else
+            printf("Found '%s' in: %s\n", data->substring, path);
+        pthread_mutex_unlock(&data->output_mutex);
+    }
+    if (cancel_requested(&data->cancel))
+        queue_cancel(data->queue);
 }
 
 void *worker(void *arg)
 {
     thread_data *data = (thread_data *)arg;
     task_queue *q = data->queue;
+    dir_reader reader;
+    dir_reader_init(&reader, DIR_READER_BUFFER_SIZE);
+    char *block = (char *)malloc(READ_BLOCK_SIZE + strlen(data->substring));
 
     while (1)
     {
@@ -141,40 +241,42 @@ void *worker(void *arg)
 
         if (node->is_dir)
         {
-            DIR *dir = opendir(node->path);
-            if (dir)
+            if (dir_reader_open(&reader, node->path) == 0)
             {
-                struct dirent *entry;
-                while ((entry = readdir(dir)) != NULL)
+                const char *name;
+                unsigned char type;
+                while (!cancel_requested(&data->cancel) && dir_reader_next(&reader, &name, &type) > 0)
                 {
-                    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+                    if (type == DT_UNKNOWN)
                         continue;
 
                     char full_path[PATH_MAX];
-                    snprintf(full_path, sizeof(full_path), "%s/%s", node->path, entry->d_name);
+                    snprintf(full_path, sizeof(full_path), "%s/%s", node->path, name);
 
-                    struct stat st;
-                    if (stat(full_path, &st) != 0)
-                        continue;
+                    long long size = 0;
+                    if (type == DT_REG)
+                    {
+                        if (!file_filter_accepts_name(&data->filter, name))
+                            continue;
+                        size = dir_reader_file_size(&reader, name);
+                    }
 
-                    enqueue(q, full_path, S_ISDIR(st.st_mode));
+                    enqueue(q, full_path, type == DT_DIR, size);
                 }
-                closedir(dir);
+                dir_reader_close(&reader);
             }
         }
         else
         {
-            const char *ext = strrchr(node->path, '.');
-            if (ext && strcmp(ext, ".txt") == 0)
-            {
-                process_file(node->path, data->substring, &data->output_mutex);
-            }
+            process_file(node->path, data, block);
         }
 
         free(node->path);
         free(node);
         task_complete(q);
     }
+    dir_reader_destroy(&reader);
+    free(block);
     return NULL;
 }
 
@@ -190,37 +292,80 @@ void queue_destroy(task_queue *q)
         free(current);
         current = next;
     }
+    for (size_t i = 0; i < q->files_count; i++)
+    {
+        free(q->files[i]->path);
+        free(q->files[i]);
+    }
+    free(q->files);
 }
 
 int main(int argc, char *argv[])
 {
-    if (argc != 3)
+    int files_with_matches = 0;
+    long max_matches = 0;
+    int bad_option = 0;
+    int option;
+    thread_data data;
+    file_filter_init(&data.filter);
+    while ((option = getopt(argc, argv, "+lm:i:x:a")) != -1)
+    {
+        if (option == 'l')
+            files_with_matches = 1;
+        else if (option == 'i')
+            glob_set_add(&data.filter.include, optarg);
+        else if (option == 'x')
+            glob_set_add(&data.filter.exclude, optarg);
+        else if (option == 'a')
+            data.filter.scan_binary = 1;
+        else if (option == 'm' && atol(optarg) > 0)
+            max_matches = atol(optarg);
+        else
+            bad_option = 1;
+    }
+    int positional = argc - optind;
+    if (bad_option || (positional != 2 && positional != 3))
+    {
+        fprintf(stderr, "Usage: %s [-l] [-m N] [-i GLOB]... [-x GLOB]... [-a] <directory> <substring> [threads]\n",
+                argv[0]);
+        fprintf(stderr, "  -l       print only names of matching files\n");
+        fprintf(stderr, "  -m N     stop after N matching files\n");
+        fprintf(stderr, "  -i GLOB  scan only files whose name matches one of the -i globs\n");
+        fprintf(stderr, "  -x GLOB  skip files whose name matches\n");
+        fprintf(stderr, "  -a       scan binary files too\n");
+        return 1;
+    }
+    int threads_num = positional == 3 ? atoi(argv[optind + 2]) : MAX_THREADS;
+    if (threads_num < 1)
     {
-        fprintf(stderr, "Usage: %s <directory> <substring>\n", argv[0]);
+        fprintf(stderr, "threads < 1\n");
         return 1;
     }
 
     task_queue q;
-    queue_init(&q);
-    enqueue(&q, argv[1], 1);
+    cancel_token_init(&data.cancel, max_matches);
+    queue_init(&q, &data.cancel);
+    enqueue(&q, argv[optind], 1, 0);
 
-    thread_data data;
     data.queue = &q;
-    data.substring = argv[2];
+    data.substring = argv[optind + 1];
+    data.files_with_matches = files_with_matches;
     pthread_mutex_init(&data.output_mutex, NULL);
 
-    pthread_t threads[MAX_THREADS];
-    for (int i = 0; i < MAX_THREADS; i++)
+    pthread_t *threads = (pthread_t *)malloc(threads_num * sizeof(pthread_t));
+    for (int i = 0; i < threads_num; i++)
     {
         pthread_create(&threads[i], NULL, worker, &data);
     }
 
-    for (int i = 0; i < MAX_THREADS; i++)
+    for (int i = 0; i < threads_num; i++)
     {
         pthread_join(threads[i], NULL);
     }
+    free(threads);
 
     queue_destroy(&q);
     pthread_mutex_destroy(&data.output_mutex);
+    file_filter_destroy(&data.filter);
     return 0;
 }
\ No newline at end of file
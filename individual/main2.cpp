@@ -10,6 +10,10 @@
 #include <string>
 #include <queue>
 #include <pthread.h>
+#include <vector>
+#include "dir_reader.h"
+#include "cancel_token.h"
+#include "file_filter.h"
 
 #define err_exit(code, str)                                              \
         {                                                                \
@@ -22,10 +26,26 @@ struct thread_attr
         const char *substring;
 };
 
-std::queue<const char *> tasks_queue;
+struct file_task
+{
+        long long size;
+        const char *path;
+
+        bool operator<(const file_task &other) const
+        {
+                return size < other.size;
+        }
+};
+
+// Largest files first: a giant file found late must not become the only work left.
+// Directories are walked by the main thread and never wait behind files
+std::priority_queue<file_task> tasks_queue;
 pthread_mutex_t mutex;
 bool isNoMoreTasksComing = false;
 void (*do_task_func)(void *, const char *);
+cancel_token cancel;             // Set once -m N matches were printed
+bool files_with_matches = false; // -l: print only the names of matching files
+file_filter filter;              // -i/-x globs (*.txt by default) and binary detection
 
 void *thread_pool_function(void *arg)
 {
@@ -33,23 +53,30 @@ void *thread_pool_function(void *arg)
 
         while (true)
         {
+                // Tasks left in the queue after cancellation are dropped unopened
+                if (cancel_requested(&cancel))
+                        return NULL;
+
                 err = pthread_mutex_lock(&mutex);
                 if (err != 0)
                         err_exit(err, "Cannot lock mutex");
 
                 if (tasks_queue.empty())
                 {
+                        // The flag is read under the mutex, otherwise the last tasks can be left unprocessed
+                        bool finished = isNoMoreTasksComing;
+
                         err = pthread_mutex_unlock(&mutex);
                         if (err != 0)
                                 err_exit(err, "Cannot unlock mutex");
 
-                        if (isNoMoreTasksComing)
+                        if (finished)
                                 return NULL;
 
                         continue;
                 }
 
-                const char *task = tasks_queue.front();
+                const char *task = tasks_queue.top().path;
                 tasks_queue.pop();
 
                 err = pthread_mutex_unlock(&mutex);
@@ -63,11 +90,11 @@ void *thread_pool_function(void *arg)
         }
 }
 
-void add_task(const char *new_task)
+void add_task(const char *new_task, long long size)
 {
         int err;
 
-        if (isNoMoreTasksComing)
+        if (isNoMoreTasksComing || cancel_requested(&cancel))
                 return;
 
         err = pthread_mutex_lock(&mutex);
@@ -75,7 +102,7 @@ void add_task(const char *new_task)
                 err_exit(err, "Cannot lock mutex");
 
         char *task_copy = strdup(new_task);
-        tasks_queue.push(task_copy);
+        tasks_queue.push({size, task_copy});
 
         err = pthread_mutex_unlock(&mutex);
         if (err != 0)
@@ -101,7 +128,7 @@ void find_substring_in_line_recursively(const char *substring, uint substr_len,
 {
         size_t pos = line.find(substring);
 
-        if (pos == std::string::npos)
+        if (pos == std::string::npos || !cancel_claim_match(&cancel))
         {
                 return;
         }
@@ -122,11 +149,33 @@ void find_substrings_in_file(void *arg, const char *file_path)
                 return;
         }
 
+        if (!filter.scan_binary)
+        {
+                // Only the first block is read until the file is known to be text
+                char block[SNIFF_SIZE];
+                file.read(block, SNIFF_SIZE);
+                if (looks_binary(block, file.gcount()))
+                        return;
+
+                file.clear();
+                file.seekg(0);
+        }
+
         std::string line;
         uint line_index = 1;
 
-        while (std::getline(file, line))
+        while (!cancel_requested(&cancel) && std::getline(file, line))
         {
+                if (files_with_matches)
+                {
+                        if (line.find(thread_struct->substring) == std::string::npos)
+                                continue;
+
+                        if (cancel_claim_match(&cancel))
+                                std::cout << file_path << std::endl;
+                        break;
+                }
+
                 find_substring_in_line_recursively(thread_struct->substring, std::strlen(thread_struct->substring), line, file_path, line_index, 0);
                 line_index++;
         }
@@ -134,58 +183,94 @@ void find_substrings_in_file(void *arg, const char *file_path)
         file.close();
 }
 
-void find_substring_recursively(const char *substring, const char *directory)
+// Subdirectories are walked after the directory is closed, so one reader buffer serves the whole walk
+void find_substring_recursively(const char *substring, const char *directory, dir_reader *reader)
 {
-        DIR *dir = opendir(directory);
-        if (!dir)
+        if (dir_reader_open(reader, directory) != 0)
         {
                 std::cout << "Cannot open a directory" << std::endl;
                 return;
         }
 
-        struct stat info;
-        struct dirent *files;
+        const char *name;
+        unsigned char type;
         char temp_path[PATH_MAX];
-        size_t file_name_length;
+        std::vector<std::string> subdirectories;
 
-        while ((files = readdir(dir)) != NULL)
+        while (!cancel_requested(&cancel) && dir_reader_next(reader, &name, &type) > 0)
         {
-                if (strcmp(files->d_name, ".") == 0 || strcmp(files->d_name, "..") == 0)
-                        continue;
-
-                file_name_length = std::strlen(files->d_name);
-                snprintf(temp_path, PATH_MAX, "%s/%s", directory, files->d_name);
+                snprintf(temp_path, PATH_MAX, "%s/%s", directory, name);
 
-                if (stat(temp_path, &info) == 0 && S_ISDIR(info.st_mode))
+                if (type == DT_DIR)
                 {
-                        // std::cout << "dir: " << temp_path << std::endl;
-                        find_substring_recursively(substring, temp_path);
+                        subdirectories.push_back(temp_path);
                 }
 
-                else if (file_name_length > 4 && strcmp(files->d_name + file_name_length - 4, ".txt") == 0)
+                else if (type == DT_REG && file_filter_accepts_name(&filter, name))
                 {
-                        // std::cout << "txt: " << temp_path << std::endl;
-                        add_task(temp_path);
+                        add_task(temp_path, dir_reader_file_size(reader, name));
                 }
         }
 
-        closedir(dir);
+        dir_reader_close(reader);
+
+        for (const std::string &subdirectory : subdirectories)
+        {
+                if (cancel_requested(&cancel))
+                        break;
+
+                find_substring_recursively(substring, subdirectory.c_str(), reader);
+        }
 }
 
 void find_substring_in_all_files(const char *substring, const char *directory)
 {
-        find_substring_recursively(substring, directory);
+        dir_reader reader;
+        dir_reader_init(&reader, DIR_READER_BUFFER_SIZE);
+
+        find_substring_recursively(substring, directory, &reader);
+
+        dir_reader_destroy(&reader);
 
         stop_receiving_tasks();
 }
 
 int main(int argc, char *argv[])
 {
-        if (argc != 4)
+        long max_matches = 0;
+        bool bad_option = false;
+        int option;
+        file_filter_init(&filter);
+        while ((option = getopt(argc, argv, "+lm:i:x:a")) != -1)
+        {
+                if (option == 'l')
+                        files_with_matches = true;
+                else if (option == 'i')
+                        glob_set_add(&filter.include, optarg);
+                else if (option == 'x')
+                        glob_set_add(&filter.exclude, optarg);
+                else if (option == 'a')
+                        filter.scan_binary = 1;
+                else if (option == 'm' && atol(optarg) > 0)
+                        max_matches = atol(optarg);
+                else
+                        bad_option = true;
+        }
+
+        if (bad_option || argc - optind != 3)
         {
-                std::cout << "substring? threads_num? directory?" << std::endl;
+                std::cout << "[-l] [-m N] [-i GLOB]... [-x GLOB]... [-a] substring? threads_num? directory?" << std::endl;
+                std::cout << "  -l       print only names of matching files" << std::endl;
+                std::cout << "  -m N     stop after N matches (N files with -l)" << std::endl;
+                std::cout << "  -i GLOB  scan only files matching one of the -i globs (default *.txt)" << std::endl;
+                std::cout << "  -x GLOB  skip files whose name matches" << std::endl;
+                std::cout << "  -a       scan binary files too" << std::endl;
                 exit(-1);
         }
+        if (filter.include.suffix_count + filter.include.pattern_count == 0)
+                glob_set_add(&filter.include, "*.txt");
+        argv += optind - 1;
+        cancel_token_init(&cancel, max_matches);
 
         const char *substring = argv[1];
 
@@ -222,6 +307,10 @@ int main(int argc, char *argv[])
         pthread_t *threads;
         threads = new pthread_t[threads_num];
 
+        err = pthread_mutex_init(&mutex, NULL);
+        if (err != 0)
+                err_exit(err, "Cannot initialize mutex");
+
         for (int i = 0; i < threads_num; i++)
         {
                 err = pthread_create(&threads[i], NULL, thread_pool_function, &arg);
@@ -229,10 +318,6 @@ int main(int argc, char *argv[])
                         err_exit(err, "Cannot create a thread");
         }
 
-        err = pthread_mutex_init(&mutex, NULL);
-        if (err != 0)
-                err_exit(err, "Cannot initialize mutex");
-
         find_substring_in_all_files(substring, directory);
 
         for (int i = 0; i < threads_num; i++)
@@ -0,0 +1,663 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <queue>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "dir_reader.h"
+#include "file_filter.h"
+#include "cancel_token.h"
+
+using namespace std;
+
+#define err_exit(code, str)                            \
+    {                                                  \
+        cerr << str << ": " << strerror(code) << endl; \
+        exit(EXIT_FAILURE);                            \
+    }
+
+/*
+Resident substring search daemon behind a local Unix socket. Unlike running main1
+per query, the scanner thread pool, the directory listing cache (name, type, size)
+and, optionally (-c), a content cache of text files stay alive between queries.
+The caches are invalidated by inotify events: a write drops the file's content,
+create, delete and rename drop the directory listing, and deleting or moving a
+directory drops everything cached under it. Results are sent to the client as they
+are found, in main1's format; the end of a reply is the connection being closed.
+
+A request is one line: root \t substring \t match limit (0 - unlimited)
+\t 1 - file names only.
+*/
+
+const uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE |
+                            IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+const size_t MAX_REQUEST_SIZE = 65536;
+const size_t READ_BLOCK_SIZE = 1 << 20;
+
+/* Cached directory entry */
+struct Entry
+{
+    string name;
+    unsigned char type; // DT_DIR or DT_REG
+    long long size;
+};
+
+/* Cached file content; binary files only keep the flag */
+struct CachedFile
+{
+    bool binary;
+    string data;
+};
+
+/*
+Directory tree cache invalidated through inotify. A directory is watched before its
+listing is read, so a change during the read is not lost: the generation counter
+grows on every invalidation, and data read while it changed is not cached
+*/
+class TreeCache
+{
+public:
+    explicit TreeCache(size_t content_budget) : content_budget(content_budget)
+    {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd < 0)
+            err_exit(errno, "Cannot initialize inotify");
+    }
+
+    int fd() const
+    {
+        return inotify_fd;
+    }
+
+    /* Directory listing from the cache or the disk; nullptr if the directory cannot be opened */
+    shared_ptr<const vector<Entry>> listing(const string &directory, dir_reader &reader)
+    {
+        unsigned long long seen;
+        {
+            lock_guard<mutex> guard(lock);
+            auto found = listings.find(directory);
+            if (found != listings.end())
+            {
+                ++listing_hits;
+                return found->second;
+            }
+            ++listing_misses;
+            seen = generation;
+        }
+        int wd = inotify_add_watch(inotify_fd, directory.c_str(), WATCH_MASK);
+        if (dir_reader_open(&reader, directory.c_str()) != 0)
+            return nullptr;
+        auto entries = make_shared<vector<Entry>>();
+        const char *name;
+        unsigned char type;
+        while (dir_reader_next(&reader, &name, &type) > 0)
+        {
+            if (type == DT_DIR)
+                entries->push_back({name, type, 0});
+            else if (type == DT_REG)
+                entries->push_back({name, type, dir_reader_file_size(&reader, name)});
+        }
+        dir_reader_close(&reader);
+        // Without a watch (inotify limit reached) nothing may be cached: changes would go unnoticed
+        lock_guard<mutex> guard(lock);
+        if (wd >= 0)
+            watches[wd] = directory;
+        if (wd >= 0 && generation == seen)
+            listings[directory] = entries;
+        return entries;
+    }
+
+    shared_ptr<const CachedFile> content(const string &path)
+    {
+        lock_guard<mutex> guard(lock);
+        auto found = contents.find(path);
+        return found == contents.end() ? nullptr : found->second;
+    }
+
+    /* Current generation: taken before reading a file and passed to store_content */
+    unsigned long long current_generation()
+    {
+        lock_guard<mutex> guard(lock);
+        return generation;
+    }
+
+    /* Whether a file of this size fits into the content cache budget */
+    bool wants_content(long long size)
+    {
+        lock_guard<mutex> guard(lock);
+        return content_bytes + size <= content_budget;
+    }
+
+    /* Stores the content if the budget allows and nothing changed since generation seen */
+    void store_content(const string &path, shared_ptr<const CachedFile> file, unsigned long long seen)
+    {
+        lock_guard<mutex> guard(lock);
+        if (generation != seen || content_bytes + file->data.size() > content_budget || contents.count(path))
+            return;
+        contents[path] = file;
+        content_bytes += file->data.size();
+    }
+
+    /* Drains pending inotify events */
+    void handle_events()
+    {
+        alignas(inotify_event) char buffer[65536];
+        ssize_t count;
+        while ((count = read(inotify_fd, buffer, sizeof(buffer))) > 0)
+        {
+            lock_guard<mutex> guard(lock);
+            for (char *p = buffer; p < buffer + count;)
+            {
+                inotify_event *event = reinterpret_cast<inotify_event *>(p);
+                p += sizeof(inotify_event) + event->len;
+                handle_event(event);
+            }
+        }
+    }
+
+    string statistics()
+    {
+        lock_guard<mutex> guard(lock);
+        return "listings " + to_string(listings.size()) + " (hits " + to_string(listing_hits) + ", misses " +
+               to_string(listing_misses) + "), cached files " + to_string(contents.size()) + " (" +
+               to_string(content_bytes >> 20) + " MiB), invalidations " + to_string(generation);
+    }
+
+private:
+    void handle_event(const inotify_event *event)
+    {
+        if (event->mask & IN_Q_OVERFLOW)
+        {
+            // Events were lost: nothing can be trusted
+            listings.clear();
+            contents.clear();
+            content_bytes = 0;
+            ++generation;
+            return;
+        }
+        auto watch = watches.find(event->wd);
+        if (watch == watches.end())
+            return;
+        const string directory = watch->second;
+        if (event->mask & IN_IGNORED)
+        {
+            watches.erase(watch);
+            invalidate_subtree(directory);
+            return;
+        }
+        if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+        {
+            invalidate_subtree(directory);
+            return;
+        }
+        string path = event->len ? directory + "/" + event->name : directory;
+        if (event->mask & IN_ISDIR)
+        {
+            if (event->mask & (IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO))
+                invalidate_subtree(path);
+            invalidate_listing(directory);
+            return;
+        }
+        invalidate_content(path);
+        // A write changes the listed size, but that only orders the tasks and files are
+        // read to EOF, so the listing is dropped only once the file is closed
+        if (event->mask & ~IN_MODIFY)
+            invalidate_listing(directory);
+    }
+
+    void invalidate_listing(const string &directory)
+    {
+        listings.erase(directory);
+        ++generation;
+    }
+
+    void invalidate_content(const string &path)
+    {
+        auto found = contents.find(path);
+        if (found != contents.end())
+        {
+            content_bytes -= found->second->data.size();
+            contents.erase(found);
+        }
+        ++generation;
+    }
+
+    /* Drops the directory and everything cached under it */
+    void invalidate_subtree(const string &directory)
+    {
+        listings.erase(directory);
+        string prefix = directory + "/";
+        listings.erase(listings.lower_bound(prefix), listings.lower_bound(directory + "0")); // '0' follows '/'
+        for (auto it = contents.lower_bound(prefix); it != contents.end() && it->first.compare(0, prefix.size(), prefix) == 0;)
+        {
+            content_bytes -= it->second->data.size();
+            it = contents.erase(it);
+        }
+        ++generation;
+    }
+
+    int inotify_fd;
+    size_t content_budget;
+    mutex lock;
+    map<string, shared_ptr<const vector<Entry>>> listings; // Ordered so that a subtree is a range
+    map<string, shared_ptr<const CachedFile>> contents;
+    size_t content_bytes = 0;
+    unordered_map<int, string> watches;
+    unsigned long long generation = 0;
+    unsigned long long listing_hits = 0;
+    unsigned long long listing_misses = 0;
+};
+
+/* One client query */
+struct Query
+{
+    int client;
+    string needle;
+    bool files_only;
+    cancel_token cancel;
+    mutex output_mutex;
+    mutex done_mutex;
+    condition_variable done;
+    int pending = 0; // Unfinished scan tasks, guarded by done_mutex
+};
+
+bool write_full(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+/* File scan task; larger files are handed out first */
+struct ScanTask
+{
+    long long size;
+    string path;
+    shared_ptr<Query> query;
+
+    bool operator<(const ScanTask &other) const
+    {
+        return size < other.size;
+    }
+};
+
+/* Persistent scanner pool shared by all queries */
+class SearchPool
+{
+public:
+    SearchPool(int threads, TreeCache &cache, const file_filter &filter) : cache(cache), filter(filter)
+    {
+        for (int i = 0; i < threads; ++i)
+            workers.emplace_back(&SearchPool::worker_loop, this);
+    }
+
+    void submit(ScanTask task)
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            tasks.push(move(task));
+        }
+        ready.notify_one();
+    }
+
+private:
+    void worker_loop()
+    {
+        vector<char> block;
+        while (true)
+        {
+            ScanTask task;
+            {
+                unique_lock<mutex> guard(lock);
+                ready.wait(guard, [this] { return !tasks.empty(); });
+                task = tasks.top();
+                tasks.pop();
+            }
+            // Tasks of a cancelled query are dropped without touching the disk
+            if (!cancel_requested(&task.query->cancel))
+                scan(task, block);
+            Query &query = *task.query;
+            lock_guard<mutex> guard(query.done_mutex);
+            if (--query.pending == 0)
+                query.done.notify_all();
+        }
+    }
+
+    void scan(const ScanTask &task, vector<char> &block)
+    {
+        Query &query = *task.query;
+        bool found;
+        shared_ptr<const CachedFile> cached = cache.content(task.path);
+        if (cached)
+            found = !cached->binary && memmem(cached->data.data(), cached->data.size(), query.needle.data(),
+                                              query.needle.size()) != nullptr;
+        else if (cache.wants_content(task.size))
+            found = scan_and_cache(task, query);
+        else
+            found = scan_stream(task.path, query, block);
+        if (!found || !cancel_claim_match(&query.cancel))
+            return;
+        string line = query.files_only ? task.path + "\n" : "Found '" + query.needle + "' in: " + task.path + "\n";
+        lock_guard<mutex> guard(query.output_mutex);
+        // The client is gone - no point searching further
+        if (!write_full(query.client, line.data(), line.size()))
+            cancel_request(&query.cancel);
+    }
+
+    /*
+    Reads the whole file and keeps it in the content cache. The size comes from fstat
+    on the open file and reading continues to EOF: the listed size goes stale while
+    the file is being appended to. As in scan_stream, only the SNIFF_SIZE block is
+    read first, and a binary file is not read any further
+    */
+    bool scan_and_cache(const ScanTask &task, Query &query)
+    {
+        unsigned long long seen = cache.current_generation();
+        int fd = open(task.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        auto file = make_shared<CachedFile>();
+        // One spare byte so the read that hits EOF does not double the buffer
+        file->data.resize(max<size_t>(SNIFF_SIZE, fstat(fd, &info) == 0 ? info.st_size + 1 : 0));
+        size_t size = 0;
+        ssize_t count;
+        while (size < SNIFF_SIZE && (count = read(fd, &file->data[size], SNIFF_SIZE - size)) > 0)
+            size += count;
+        file->binary = !filter.scan_binary && looks_binary(file->data.data(), size);
+        // A short first block means the file has already ended
+        bool more = !file->binary && size == SNIFF_SIZE;
+        while (more)
+        {
+            if (size == file->data.size())
+                file->data.resize(size * 2);
+            count = read(fd, &file->data[size], file->data.size() - size);
+            more = count > 0;
+            size += more ? count : 0;
+        }
+        close(fd);
+        file->data.resize(file->binary ? 0 : size);
+        cache.store_content(task.path, file, seen);
+        return !file->binary && memmem(file->data.data(), size, query.needle.data(), query.needle.size()) != nullptr;
+    }
+
+    /* Block reads as in main1: a small block first for the binary check */
+    bool scan_stream(const string &path, Query &query, vector<char> &block)
+    {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        size_t needle_length = query.needle.size();
+        block.resize(READ_BLOCK_SIZE + needle_length);
+        size_t carried = 0;
+        bool found = false;
+        bool first_block = true;
+        while (!found && !cancel_requested(&query.cancel))
+        {
+            ssize_t count = read(fd, block.data() + carried, first_block ? SNIFF_SIZE : READ_BLOCK_SIZE);
+            if (count <= 0)
+                break;
+            if (first_block && !filter.scan_binary && looks_binary(block.data(), count))
+                break;
+            first_block = false;
+            size_t size = carried + count;
+            found = memmem(block.data(), size, query.needle.data(), needle_length) != nullptr;
+            // Carry the block tail so a match across a block boundary is not lost
+            carried = min(size, needle_length > 0 ? needle_length - 1 : 0);
+            memmove(block.data(), block.data() + size - carried, carried);
+        }
+        close(fd);
+        return found;
+    }
+
+    TreeCache &cache;
+    const file_filter &filter;
+    mutex lock;
+    condition_variable ready;
+    priority_queue<ScanTask> tasks;
+    vector<thread> workers;
+};
+
+/* Reads the request line up to '\n'; false if the client did not send a request */
+bool read_request(int client, string &request)
+{
+    char buffer[4096];
+    while (request.find('\n') == string::npos)
+    {
+        if (request.size() > MAX_REQUEST_SIZE)
+            return false;
+        ssize_t count = recv(client, buffer, sizeof(buffer), 0);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        request.append(buffer, count);
+    }
+    request.resize(request.find('\n'));
+    return true;
+}
+
+void serve_client(int client, TreeCache &cache, SearchPool &pool, const file_filter &filter)
+{
+    string request;
+    vector<string> fields;
+    if (read_request(client, request))
+    {
+        size_t start = 0, tab;
+        while ((tab = request.find('\t', start)) != string::npos)
+        {
+            fields.push_back(request.substr(start, tab - start));
+            start = tab + 1;
+        }
+        fields.push_back(request.substr(start));
+    }
+    char root[PATH_MAX];
+    if (fields.size() != 4 || fields[1].empty() || !realpath(fields[0].c_str(), root))
+    {
+        const char *error = "ERROR bad request\n";
+        write_full(client, error, strlen(error));
+        close(client);
+        return;
+    }
+    auto query = make_shared<Query>();
+    query->client = client;
+    query->needle = fields[1];
+    query->files_only = fields[3] == "1";
+    cancel_token_init(&query->cancel, max(0L, atol(fields[2].c_str())));
+    // Walk the cached listings; directories are walked by this thread and never wait behind queued files
+    dir_reader reader;
+    dir_reader_init(&reader, DIR_READER_BUFFER_SIZE);
+    vector<string> directories = {root};
+    while (!directories.empty() && !cancel_requested(&query->cancel))
+    {
+        string directory = move(directories.back());
+        directories.pop_back();
+        auto entries = cache.listing(directory, reader);
+        if (!entries)
+            continue;
+        for (const Entry &entry : *entries)
+        {
+            string path = directory == "/" ? "/" + entry.name : directory + "/" + entry.name;
+            if (entry.type == DT_DIR)
+                directories.push_back(path);
+            else if (file_filter_accepts_name(&filter, entry.name.c_str()))
+            {
+                {
+                    lock_guard<mutex> guard(query->done_mutex);
+                    ++query->pending;
+                }
+                pool.submit({entry.size, path, query});
+            }
+        }
+    }
+    dir_reader_destroy(&reader);
+    unique_lock<mutex> guard(query->done_mutex);
+    query->done.wait(guard, [&] { return query->pending == 0; });
+    close(client);
+}
+
+volatile sig_atomic_t stopping = 0;
+
+void stop_handler(int)
+{
+    stopping = 1;
+}
+
+int listen_socket(const string &path)
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        cerr << "Socket path is too long" << endl;
+        exit(EXIT_FAILURE);
+    }
+    strcpy(address.sun_path, path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        err_exit(errno, "Cannot create socket");
+    unlink(path.c_str());
+    if (bind(fd, (sockaddr *)&address, sizeof(address)) != 0)
+        err_exit(errno, "Cannot bind " + path);
+    if (listen(fd, 128) != 0)
+        err_exit(errno, "Cannot listen on " + path);
+    return fd;
+}
+
+int serve(const string &socket_path, int threads, size_t cache_mb, const file_filter &filter)
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_handler; // No SA_RESTART: the signal interrupts poll
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    TreeCache cache(cache_mb << 20);
+    SearchPool pool(threads, cache, filter);
+    int listener = listen_socket(socket_path);
+    cerr << "Listening on " << socket_path << " with " << threads << " threads" << endl;
+    pollfd fds[2] = {{listener, POLLIN, 0}, {cache.fd(), POLLIN, 0}};
+    while (!stopping)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            err_exit(errno, "poll failed");
+        }
+        // Handle events before new queries so they never see a stale cache
+        if (fds[1].revents & POLLIN)
+            cache.handle_events();
+        if (fds[0].revents & POLLIN)
+        {
+            int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client >= 0)
+                thread(serve_client, client, ref(cache), ref(pool), cref(filter)).detach();
+        }
+    }
+    cerr << cache.statistics() << endl;
+    close(listener);
+    unlink(socket_path.c_str());
+    // Pool threads and query handlers end with the process
+    _exit(0);
+}
+
+int query(const string &socket_path, const string &root, const string &needle, long max_matches, bool files_only)
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (sockaddr *)&address, sizeof(address)) != 0)
+        err_exit(errno, "Cannot connect to " + socket_path);
+    string request = root + "\t" + needle + "\t" + to_string(max_matches) + "\t" + (files_only ? "1" : "0") + "\n";
+    if (!write_full(fd, request.data(), request.size()))
+        err_exit(errno, "Cannot send request");
+    char buffer[65536];
+    ssize_t count;
+    while ((count = read(fd, buffer, sizeof(buffer))) > 0)
+    {
+        if (write(STDOUT_FILENO, buffer, count) != count)
+            break;
+    }
+    close(fd);
+    return 0;
+}
+
+void print_usage(const char *program)
+{
+    cerr << "Usage: " << program << " serve <socket> [-t threads] [-c cache_mb] [-i GLOB]... [-x GLOB]... [-a]\n"
+         << "       " << program << " query <socket> [-l] [-m N] <directory> <substring>" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    string mode = argv[1];
+    string socket_path = argv[2];
+    int threads = max(1u, thread::hardware_concurrency());
+    size_t cache_mb = 0;
+    long max_matches = 0;
+    bool files_only = false;
+    bool bad_option = false;
+    file_filter filter;
+    file_filter_init(&filter);
+    optind = 3;
+    int option;
+    while ((option = getopt(argc, argv, "+t:c:i:x:alm:")) != -1)
+    {
+        if (option == 't')
+            threads = max(1, atoi(optarg));
+        else if (option == 'c')
+            cache_mb = max(0L, atol(optarg));
+        else if (option == 'i')
+            glob_set_add(&filter.include, optarg);
+        else if (option == 'x')
+            glob_set_add(&filter.exclude, optarg);
+        else if (option == 'a')
+            filter.scan_binary = 1;
+        else if (option == 'l')
+            files_only = true;
+        else if (option == 'm')
+            max_matches = max(0L, atol(optarg));
+        else
+            bad_option = true;
+    }
+    if (!bad_option && mode == "serve" && optind == argc)
+        return serve(socket_path, threads, cache_mb, filter);
+    if (!bad_option && mode == "query" && argc - optind == 2)
+        return query(socket_path, argv[optind], argv[optind + 1], max_matches, files_only);
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,118 @@
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <sched.h>
+
+/*
+Пул заранее выделенных слотов фиксированного размера. Вся память выделяется
+одним блоком в конструкторе, дальше слоты передаются между потоками по индексу:
+производитель берет свободный слот, заполняет его на месте и отправляет индекс
+потребителю, потребитель возвращает индекс в список свободных.
+Список свободных - стек Трайбера на индексах: в одном 64-битном слове хранится
+индекс вершины и счетчик версий, защищающий от ABA. Ни выдача, ни возврат слота
+не обращаются к куче и не копируют содержимое
+*/
+class ObjectPool
+{
+public:
+    static const size_t CACHE_LINE_SIZE = 64;
+
+    ObjectPool(size_t count, size_t slot_size)
+        : slot_bytes((slot_size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE),
+          slots_count(count), next(count)
+    {
+        memory = static_cast<char *>(aligned_alloc(CACHE_LINE_SIZE, slot_bytes * count));
+        if (memory == nullptr)
+            throw std::bad_alloc();
+        // Изначально свободны все слоты: 0 -> 1 -> ... -> count - 1
+        for (size_t i = 0; i < count; ++i)
+        {
+            next[i].store(i + 1 < count ? (int32_t)(i + 1) : -1, std::memory_order_relaxed);
+        }
+        head.store(pack(0, count > 0 ? 0 : -1), std::memory_order_relaxed);
+    }
+
+    ~ObjectPool()
+    {
+        free(memory);
+    }
+
+    ObjectPool(const ObjectPool &) = delete;
+    ObjectPool &operator=(const ObjectPool &) = delete;
+
+    /* Индекс свободного слота или -1, если все слоты заняты */
+    int try_acquire()
+    {
+        uint64_t current = head.load(std::memory_order_acquire);
+        while (true)
+        {
+            int32_t index = (int32_t)(uint32_t)current;
+            if (index < 0)
+                return -1;
+            int32_t following = next[index].load(std::memory_order_relaxed);
+            if (head.compare_exchange_weak(current, pack(tag(current) + 1, following),
+                                           std::memory_order_acquire, std::memory_order_acquire))
+                return index;
+        }
+    }
+
+    /* Индекс свободного слота, при пустом списке уступает процессор, пока слот не вернут */
+    int acquire()
+    {
+        int index;
+        while ((index = try_acquire()) < 0)
+            sched_yield();
+        return index;
+    }
+
+    /* Возврат слота в список свободных */
+    void release(int index)
+    {
+        uint64_t current = head.load(std::memory_order_relaxed);
+        do
+        {
+            next[index].store((int32_t)(uint32_t)current, std::memory_order_relaxed);
+        } while (!head.compare_exchange_weak(current, pack(tag(current) + 1, index),
+                                             std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    char *data(int index)
+    {
+        return memory + (size_t)index * slot_bytes;
+    }
+
+    size_t slot_size() const
+    {
+        return slot_bytes;
+    }
+
+    size_t count() const
+    {
+        return slots_count;
+    }
+
+private:
+    static uint64_t pack(uint32_t version, int32_t index)
+    {
+        return ((uint64_t)version << 32) | (uint32_t)index;
+    }
+
+    static uint32_t tag(uint64_t value)
+    {
+        return (uint32_t)(value >> 32);
+    }
+
+    size_t slot_bytes;                      // Размер слота, округленный до кэш-линии
+    size_t slots_count;
+    char *memory;                           // Память всех слотов одним блоком
+    std::vector<std::atomic<int32_t>> next; // Следующий свободный слот для каждого слота
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head{0};
+};
+
+#endif
@@ -0,0 +1,501 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/*
+Постоянный пул потоков с кражей работы и алгоритмы fork-join поверх него:
+parallel_for, parallel_reduce и parallel_scan.
+Диапазон делится рекурсивно пополам: правая половина отдается в очередь текущего
+потока, левая обрабатывается сразу, пока не останется кусок не больше grain.
+Поток берет работу с конца своей очереди (самые мелкие и свежие куски, их данные
+еще в кэше), а простаивающий поток крадет с начала чужой очереди (самые крупные
+куски), поэтому кражи редки, а работа сама выравнивается при неравной стоимости.
+Ожидающий завершения своих кусков поток не спит, а выполняет чужую работу.
+Пул из N участников - это N - 1 фоновых потоков и вызывающий поток, который
+работает, пока ждет завершения области
+*/
+class ThreadPool
+{
+public:
+    /* Задание в очереди: функция и ее контекст, хранящийся в стеке ожидающего потока */
+    struct Job
+    {
+        void (*run)(void *);
+        void *context;
+    };
+
+    explicit ThreadPool(int threads = 0)
+    {
+        if (threads <= 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        queues = std::vector<WorkerQueue>(threads);
+        tids = std::vector<pid_t>(threads, 0);
+        tids[0] = syscall(SYS_gettid);
+        for (int worker = 1; worker < threads; ++worker)
+            workers.emplace_back(&ThreadPool::worker_loop, this, worker);
+        // Ждем, пока фоновые потоки запишут свои идентификаторы
+        std::unique_lock<std::mutex> guard(idle_mutex);
+        idle.wait(guard, [this] { return started == (int)workers.size(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(idle_mutex);
+            stopping = true;
+        }
+        idle.notify_all();
+        for (auto &worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /* Количество участников: фоновые потоки и вызывающий поток */
+    int size() const
+    {
+        return queues.size();
+    }
+
+    /*
+    Идентификаторы потоков ядра (gettid) участников: [0] - поток, создавший пул,
+    остальные - фоновые потоки. Нужны, чтобы навесить на пул счетчики perf
+    */
+    const std::vector<pid_t> &thread_ids() const
+    {
+        return tids;
+    }
+
+    /* Ставит задание в очередь текущего потока (для внешних потоков - в общую очередь 0) */
+    void push(Job job)
+    {
+        WorkerQueue &queue = queues[current_slot()];
+        {
+            std::lock_guard<std::mutex> guard(queue.mutex);
+            queue.jobs.push_back(job);
+        }
+        generation.fetch_add(1);
+        if (sleeping.load() > 0)
+        {
+            std::lock_guard<std::mutex> guard(idle_mutex);
+            idle.notify_one();
+        }
+    }
+
+    /* Выполняет чужие задания, пока счетчик незавершенных заданий не обнулится */
+    void wait(std::atomic<int> &pending)
+    {
+        int slot = current_slot();
+        while (pending.load(std::memory_order_acquire) != 0)
+        {
+            Job job;
+            if (find_job(slot, job))
+                job.run(job.context);
+            else
+                sched_yield();
+        }
+    }
+
+    /* Пул по умолчанию: по участнику на ядро, создается при первом обращении */
+    static ThreadPool &shared()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+private:
+    struct alignas(64) WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    /* Слот очереди текущего потока: свой у потоков пула, 0 у всех остальных */
+    int current_slot() const
+    {
+        return current_pool == this ? current_worker : 0;
+    }
+
+    bool pop_back(int slot, Job &job)
+    {
+        std::lock_guard<std::mutex> guard(queues[slot].mutex);
+        if (queues[slot].jobs.empty())
+            return false;
+        job = queues[slot].jobs.back();
+        queues[slot].jobs.pop_back();
+        return true;
+    }
+
+    bool steal_front(int slot, Job &job)
+    {
+        std::lock_guard<std::mutex> guard(queues[slot].mutex);
+        if (queues[slot].jobs.empty())
+            return false;
+        job = queues[slot].jobs.front();
+        queues[slot].jobs.pop_front();
+        return true;
+    }
+
+    bool find_job(int slot, Job &job)
+    {
+        if (pop_back(slot, job))
+            return true;
+        for (size_t offset = 1; offset < queues.size(); ++offset)
+        {
+            if (steal_front((slot + offset) % queues.size(), job))
+                return true;
+        }
+        return false;
+    }
+
+    void worker_loop(int worker)
+    {
+        const int SPIN_ROUNDS = 64; // Попыток найти работу перед засыпанием
+        current_pool = this;
+        current_worker = worker;
+        {
+            std::lock_guard<std::mutex> guard(idle_mutex);
+            tids[worker] = syscall(SYS_gettid);
+            ++started;
+        }
+        idle.notify_all();
+        int idle_rounds = 0;
+        while (true)
+        {
+            // Поколение читается до поиска, чтобы не пропустить задание, поставленное во время поиска
+            unsigned long long seen = generation.load();
+            Job job;
+            if (find_job(worker, job))
+            {
+                job.run(job.context);
+                idle_rounds = 0;
+                continue;
+            }
+            if (++idle_rounds < SPIN_ROUNDS)
+            {
+                sched_yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(idle_mutex);
+            sleeping.fetch_add(1);
+            idle.wait(guard, [this, seen] { return stopping || generation.load() != seen; });
+            sleeping.fetch_sub(1);
+            if (stopping)
+                return;
+            idle_rounds = 0;
+        }
+    }
+
+    std::vector<WorkerQueue> queues;
+    std::vector<std::thread> workers;
+    std::vector<pid_t> tids;
+    int started = 0; // Сколько фоновых потоков записало свой идентификатор
+    std::atomic<unsigned long long> generation{0}; // Меняется при каждой постановке задания
+    std::atomic<int> sleeping{0};                  // Сколько фоновых потоков спит на idle
+    std::mutex idle_mutex;
+    std::condition_variable idle;
+    bool stopping = false;
+
+    static thread_local ThreadPool *current_pool; // Пул, которому принадлежит текущий поток
+    static thread_local int current_worker;       // Номер слота текущего потока в этом пуле
+};
+
+inline thread_local ThreadPool *ThreadPool::current_pool = nullptr;
+inline thread_local int ThreadPool::current_worker = 0;
+
+/*
+Команда из N выделенных постоянных потоков для замеров, где важно, что N участников
+действительно работают одновременно: run(body) вызывает body(i) ровно один раз
+на потоке i, все потоки стартуют с одного барьера, а run возвращается после барьера
+завершения. В пуле с кражей работы куски parallel_for может выполнить по очереди
+один поток, поэтому N кусков не означают N соперничающих потоков.
+Вызывающий поток только отпускает и ждет команду, сам body не выполняет
+*/
+class ThreadTeam
+{
+public:
+    explicit ThreadTeam(int threads)
+    {
+        members = std::vector<Member>(std::max(1, threads));
+        tids = std::vector<pid_t>(members.size(), 0);
+        pthread_barrier_init(&start_barrier, nullptr, members.size() + 1);
+        pthread_barrier_init(&finish_barrier, nullptr, members.size() + 1);
+        for (size_t i = 0; i < members.size(); ++i)
+        {
+            members[i] = Member{this, (int)i, pthread_t()};
+            int err = pthread_create(&members[i].thread, nullptr, thread_main, &members[i]);
+            if (err != 0)
+                throw std::system_error(err, std::generic_category(), "Cannot create a team thread");
+        }
+        // Первый проход барьера: все потоки запущены и записали свои идентификаторы
+        pthread_barrier_wait(&start_barrier);
+    }
+
+    ~ThreadTeam()
+    {
+        stopping = true;
+        pthread_barrier_wait(&start_barrier);
+        for (auto &member : members)
+            pthread_join(member.thread, nullptr);
+        pthread_barrier_destroy(&start_barrier);
+        pthread_barrier_destroy(&finish_barrier);
+    }
+
+    ThreadTeam(const ThreadTeam &) = delete;
+    ThreadTeam &operator=(const ThreadTeam &) = delete;
+
+    int size() const
+    {
+        return members.size();
+    }
+
+    /* Идентификаторы потоков ядра (gettid) участников по номерам */
+    const std::vector<pid_t> &thread_ids() const
+    {
+        return tids;
+    }
+
+    /* Выполняет body(i) на каждом участнике i одновременно и ждет завершения всех */
+    template <typename Body>
+    void run(const Body &body)
+    {
+        job = [](const void *context, int member) { (*static_cast<const Body *>(context))(member); };
+        job_context = &body;
+        // Барьер упорядочивает запись задания перед его чтением участниками
+        pthread_barrier_wait(&start_barrier);
+        pthread_barrier_wait(&finish_barrier);
+    }
+
+private:
+    struct Member
+    {
+        ThreadTeam *team;
+        int index;
+        pthread_t thread;
+    };
+
+    static void *thread_main(void *arg)
+    {
+        Member *member = static_cast<Member *>(arg);
+        ThreadTeam *team = member->team;
+        team->tids[member->index] = syscall(SYS_gettid);
+        pthread_barrier_wait(&team->start_barrier);
+        while (true)
+        {
+            pthread_barrier_wait(&team->start_barrier);
+            if (team->stopping)
+                return nullptr;
+            team->job(team->job_context, member->index);
+            pthread_barrier_wait(&team->finish_barrier);
+        }
+    }
+
+    std::vector<Member> members;
+    std::vector<pid_t> tids;
+    pthread_barrier_t start_barrier;
+    pthread_barrier_t finish_barrier;
+    void (*job)(const void *, int) = nullptr;
+    const void *job_context = nullptr;
+    bool stopping = false; // Читается участниками после барьера старта
+};
+
+namespace parallel_detail
+{
+const int MAX_FORKS = 64; // Глубина деления: диапазон int делится пополам не более 32 раз
+
+/* Размер куска по умолчанию: около восьми кусков на участника */
+inline int auto_grain(ThreadPool &pool, int count, int grain)
+{
+    return grain > 0 ? grain : std::max(1, count / (8 * pool.size()));
+}
+
+template <typename Body>
+void for_range(ThreadPool &pool, int begin, int end, int grain, const Body &body);
+
+template <typename Body>
+struct ForTask
+{
+    ThreadPool *pool;
+    int begin, end, grain;
+    const Body *body;
+    std::atomic<int> *pending;
+
+    static void run(void *context)
+    {
+        ForTask *task = static_cast<ForTask *>(context);
+        for_range(*task->pool, task->begin, task->end, task->grain, *task->body);
+        task->pending->fetch_sub(1, std::memory_order_release);
+    }
+};
+
+template <typename Body>
+void for_range(ThreadPool &pool, int begin, int end, int grain, const Body &body)
+{
+    ForTask<Body> forks[MAX_FORKS];
+    std::atomic<int> pending{0};
+    int count = 0;
+    // Отдаем правые половины, пока остаток больше grain
+    while (end - begin > grain && count < MAX_FORKS)
+    {
+        int middle = begin + (end - begin) / 2;
+        forks[count] = ForTask<Body>{&pool, middle, end, grain, &body, &pending};
+        pending.fetch_add(1, std::memory_order_relaxed);
+        pool.push({&ForTask<Body>::run, &forks[count]});
+        ++count;
+        end = middle;
+    }
+    body(begin, end);
+    pool.wait(pending);
+}
+
+template <typename T, typename Map, typename Combine>
+T reduce_range(ThreadPool &pool, int begin, int end, int grain, const T &identity, const Map &map,
+               const Combine &combine);
+
+template <typename T, typename Map, typename Combine>
+struct ReduceTask
+{
+    ThreadPool *pool;
+    int begin, end, grain;
+    const T *identity;
+    const Map *map;
+    const Combine *combine;
+    std::atomic<int> *pending;
+    T result;
+
+    static void run(void *context)
+    {
+        ReduceTask *task = static_cast<ReduceTask *>(context);
+        task->result = reduce_range(*task->pool, task->begin, task->end, task->grain, *task->identity,
+                                    *task->map, *task->combine);
+        task->pending->fetch_sub(1, std::memory_order_release);
+    }
+};
+
+template <typename T, typename Map, typename Combine>
+T reduce_range(ThreadPool &pool, int begin, int end, int grain, const T &identity, const Map &map,
+               const Combine &combine)
+{
+    typedef ReduceTask<T, Map, Combine> Task;
+    Task forks[MAX_FORKS];
+    std::atomic<int> pending{0};
+    int count = 0;
+    while (end - begin > grain && count < MAX_FORKS)
+    {
+        int middle = begin + (end - begin) / 2;
+        forks[count] = Task{&pool, middle, end, grain, &identity, &map, &combine, &pending, identity};
+        pending.fetch_add(1, std::memory_order_relaxed);
+        pool.push({&Task::run, &forks[count]});
+        ++count;
+        end = middle;
+    }
+    T result = map(begin, end);
+    pool.wait(pending);
+    // Куски отданы справа налево, поэтому складываем от ближайшего к левому краю: порядок сохраняется
+    for (int i = count - 1; i >= 0; --i)
+        result = combine(result, forks[i].result);
+    return result;
+}
+} // namespace parallel_detail
+
+/*
+Вызывает body(begin, end) для кусков [begin, end) размером не больше grain
+(grain <= 0 - подобрать автоматически) и возвращается, когда все куски выполнены
+*/
+template <typename Body>
+void parallel_for(ThreadPool &pool, int begin, int end, int grain, const Body &body)
+{
+    if (begin >= end)
+        return;
+    parallel_detail::for_range(pool, begin, end, parallel_detail::auto_grain(pool, end - begin, grain), body);
+}
+
+template <typename Body>
+void parallel_for(int begin, int end, int grain, const Body &body)
+{
+    parallel_for(ThreadPool::shared(), begin, end, grain, body);
+}
+
+/*
+Свертка: map(begin, end) дает результат куска, combine(a, b) объединяет результаты
+соседних кусков (a левее b). combine должна быть ассоциативной; коммутативность не
+нужна, порядок кусков сохраняется
+*/
+template <typename T, typename Map, typename Combine>
+T parallel_reduce(ThreadPool &pool, int begin, int end, int grain, T identity, const Map &map,
+                  const Combine &combine)
+{
+    if (begin >= end)
+        return identity;
+    return parallel_detail::reduce_range(pool, begin, end, parallel_detail::auto_grain(pool, end - begin, grain),
+                                         identity, map, combine);
+}
+
+template <typename T, typename Map, typename Combine>
+T parallel_reduce(int begin, int end, int grain, T identity, const Map &map, const Combine &combine)
+{
+    return parallel_reduce(ThreadPool::shared(), begin, end, grain, identity, map, combine);
+}
+
+/*
+Включающий префиксный скан: out[i] = in[0] + ... + in[i] по операции combine.
+Два прохода по блокам: суммы блоков параллельно, их префикс последовательно,
+затем блоки параллельно пересчитываются со своим смещением. in и out могут совпадать
+*/
+template <typename T, typename Combine>
+void parallel_scan(ThreadPool &pool, const T *in, T *out, int count, int grain, T identity, const Combine &combine)
+{
+    if (count <= 0)
+        return;
+    int block = std::max(parallel_detail::auto_grain(pool, count, grain), (count + 4 * pool.size() - 1) / (4 * pool.size()));
+    int blocks = (count + block - 1) / block;
+    std::vector<T> offsets(blocks, identity);
+    parallel_for(pool, 0, blocks, 1, [&](int first, int last) {
+        for (int b = first; b < last; ++b)
+        {
+            T sum = identity;
+            for (int i = b * block; i < std::min(count, (b + 1) * block); ++i)
+                sum = combine(sum, in[i]);
+            offsets[b] = sum;
+        }
+    });
+    T running = identity;
+    for (int b = 0; b < blocks; ++b)
+    {
+        T sum = offsets[b];
+        offsets[b] = running;
+        running = combine(running, sum);
+    }
+    parallel_for(pool, 0, blocks, 1, [&](int first, int last) {
+        for (int b = first; b < last; ++b)
+        {
+            T sum = offsets[b];
+            for (int i = b * block; i < std::min(count, (b + 1) * block); ++i)
+            {
+                sum = combine(sum, in[i]);
+                out[i] = sum;
+            }
+        }
+    });
+}
+
+template <typename T, typename Combine>
+void parallel_scan(const T *in, T *out, int count, int grain, T identity, const Combine &combine)
+{
+    parallel_scan(ThreadPool::shared(), in, out, count, grain, identity, combine);
+}
+
+#endif
@@ -0,0 +1,236 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* События, которые снимает PerfCounters */
+enum PerfEvent
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_L1D_READ_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_CONTEXT_SWITCHES,
+    PERF_MIGRATIONS,
+    PERF_EVENT_COUNT
+};
+
+/* Значения событий за один замер; -1 - событие недоступно */
+struct PerfSample
+{
+    long long values[PERF_EVENT_COUNT];
+};
+
+/*
+Аппаратные и программные счетчики perf_event_open для набора потоков. Каждое
+событие открывается отдельно для каждого потока (tid 0 - вызывающий поток), поэтому
+можно считать и уже запущенные потоки пула, и получить значения по каждому потоку.
+Если событие открыть не удалось (нет PMU в виртуальной машине, perf_event_paranoid,
+seccomp), оно просто помечается недоступным, остальные продолжают работать.
+При мультиплексировании значения масштабируются по time_enabled / time_running.
+Аппаратные события считаются только в пользовательском режиме, как разрешено
+при perf_event_paranoid = 2
+*/
+class PerfCounters
+{
+public:
+    /* threads - идентификаторы потоков (gettid), 0 - вызывающий поток; inherit - считать и потоки, созданные позже */
+    explicit PerfCounters(const std::vector<pid_t> &threads = {0}, bool inherit = false)
+        : threads(threads), fds(threads.size() * PERF_EVENT_COUNT, -1), samples(threads.size())
+    {
+        for (size_t t = 0; t < threads.size(); ++t)
+        {
+            for (int event = 0; event < PERF_EVENT_COUNT; ++event)
+                fds[t * PERF_EVENT_COUNT + event] = open_event((PerfEvent)event, threads[t], inherit);
+        }
+    }
+
+    ~PerfCounters()
+    {
+        for (int fd : fds)
+        {
+            if (fd >= 0)
+                close(fd);
+        }
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    /* Удалось ли открыть событие хотя бы для одного потока */
+    bool available(PerfEvent event) const
+    {
+        for (size_t t = 0; t < threads.size(); ++t)
+        {
+            if (fds[t * PERF_EVENT_COUNT + event] >= 0)
+                return true;
+        }
+        return false;
+    }
+
+    void start()
+    {
+        for (int fd : fds)
+        {
+            if (fd < 0)
+                continue;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    /* Останавливает счетчики и возвращает сумму по всем потокам */
+    PerfSample stop()
+    {
+        for (int fd : fds)
+        {
+            if (fd >= 0)
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+        PerfSample total;
+        std::fill(total.values, total.values + PERF_EVENT_COUNT, -1);
+        for (size_t t = 0; t < threads.size(); ++t)
+        {
+            for (int event = 0; event < PERF_EVENT_COUNT; ++event)
+            {
+                long long value = read_scaled(fds[t * PERF_EVENT_COUNT + event]);
+                samples[t].values[event] = value;
+                if (value >= 0)
+                    total.values[event] = std::max(0LL, total.values[event]) + value;
+            }
+        }
+        return total;
+    }
+
+    /* Значения последнего замера по каждому потоку, в порядке конструктора */
+    const std::vector<PerfSample> &per_thread() const
+    {
+        return samples;
+    }
+
+    static const char *name(PerfEvent event)
+    {
+        static const char *NAMES[] = {"cycles", "instructions", "llc_misses", "l1d_read_misses",
+                                      "branch_misses", "context_switches", "migrations"};
+        return NAMES[event];
+    }
+
+private:
+    static int open_event(PerfEvent event, pid_t thread, bool inherit)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        switch (event)
+        {
+        case PERF_CYCLES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PERF_INSTRUCTIONS:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PERF_LLC_MISSES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        case PERF_L1D_READ_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case PERF_BRANCH_MISSES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        case PERF_CONTEXT_SWITCHES:
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+            break;
+        default:
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_CPU_MIGRATIONS;
+            break;
+        }
+        attr.disabled = 1;
+        attr.inherit = inherit ? 1 : 0;
+        // Программные события возникают в ядре и с exclude_kernel не считались бы никогда
+        attr.exclude_kernel = attr.type != PERF_TYPE_SOFTWARE;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return syscall(SYS_perf_event_open, &attr, thread, -1, -1, 0);
+    }
+
+    /* Значение счетчика с поправкой на мультиплексирование; -1, если счетчик недоступен */
+    static long long read_scaled(int fd)
+    {
+        if (fd < 0)
+            return -1;
+        uint64_t data[3]; // value, time_enabled, time_running
+        if (read(fd, data, sizeof(data)) != sizeof(data))
+            return -1;
+        if (data[2] == 0)
+            return data[1] == 0 ? (long long)data[0] : 0;
+        return (long long)((double)data[0] * data[1] / data[2]);
+    }
+
+    std::vector<pid_t> threads;
+    std::vector<int> fds; // fds[поток * PERF_EVENT_COUNT + событие]
+    std::vector<PerfSample> samples;
+};
+
+/* Устойчивая сводка по серии замеров */
+struct SampleStats
+{
+    double median;
+    double mad; // Медиана абсолютных отклонений от медианы
+    double p99;
+};
+
+/* Значение перцентиля p (0..100) из отсортированного вектора */
+inline double sorted_percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty())
+        return NAN;
+    size_t index = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+inline SampleStats summarize(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    SampleStats stats;
+    stats.median = sorted_percentile(values, 50);
+    stats.p99 = sorted_percentile(values, 99);
+    std::vector<double> deviations;
+    for (double value : values)
+        deviations.push_back(std::fabs(value - stats.median));
+    std::sort(deviations.begin(), deviations.end());
+    stats.mad = sorted_percentile(deviations, 50);
+    return stats;
+}
+
+/* Медиана события по замерам; -1, если событие недоступно */
+inline double median_event(const std::vector<PerfSample> &samples, PerfEvent event)
+{
+    std::vector<double> values;
+    for (const PerfSample &sample : samples)
+    {
+        if (sample.values[event] >= 0)
+            values.push_back(sample.values[event]);
+    }
+    return values.empty() ? -1 : summarize(values).median;
+}
+
+#endif
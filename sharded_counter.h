@@ -0,0 +1,108 @@
+#ifndef SHARDED_COUNTER_H
+#define SHARDED_COUNTER_H
+
+#include <atomic>
+#include <vector>
+#include <sched.h>
+#include <unistd.h>
+
+/*
+Масштабируемый счетчик. Инкременты попадают в слот текущего ядра (PER_CPU, по
+sched_getcpu) или текущего потока (PER_THREAD), каждый слот лежит на своей
+кэш-линии. Когда слот накапливает batch единиц, он сбрасывается в общий итог.
+Быстрое чтение возвращает только общий итог (погрешность не больше batch на слот),
+точное чтение дополнительно суммирует все слоты
+*/
+class ShardedCounter
+{
+public:
+    // Фиксированное значение: hardware_destructive_interference_size в заголовке зависит от -mtune
+    static const size_t CACHE_LINE_SIZE = 64;
+
+    enum Mode
+    {
+        PER_CPU,   // Слот выбирается по номеру ядра, на котором выполняется поток
+        PER_THREAD // Слот закрепляется за потоком при первом обращении
+    };
+
+    explicit ShardedCounter(Mode mode = PER_CPU, long long batch = 1024, int slots = 0)
+        : mode(mode), batch(batch), shards(slots > 0 ? slots : default_slots())
+    {
+    }
+
+    void add(long long delta = 1)
+    {
+        Shard &shard = shards[slot_index()];
+        // Слот может делить несколько потоков (миграция между ядрами, потоков больше слотов),
+        // поэтому инкремент атомарный, но линия почти всегда остается в кэше своего ядра
+        long long value = shard.value.fetch_add(delta, std::memory_order_relaxed) + delta;
+        if (value >= batch || value <= -batch)
+        {
+            long long flushed = shard.value.exchange(0, std::memory_order_relaxed);
+            total.fetch_add(flushed, std::memory_order_relaxed);
+        }
+    }
+
+    /* Быстрое приближенное значение: одно чтение общего итога */
+    long long read_approx() const
+    {
+        return total.load(std::memory_order_relaxed);
+    }
+
+    /*
+    Точное значение: общий итог плюс содержимое всех слотов. Точно, если во время
+    чтения нет конкурентных add, иначе отражает некоторый момент во время обхода
+    */
+    long long read_exact() const
+    {
+        long long sum = total.load(std::memory_order_acquire);
+        for (const Shard &shard : shards)
+        {
+            sum += shard.value.load(std::memory_order_acquire);
+        }
+        return sum;
+    }
+
+    int slot_count() const
+    {
+        return shards.size();
+    }
+
+private:
+    struct alignas(CACHE_LINE_SIZE) Shard
+    {
+        std::atomic<long long> value{0};
+    };
+
+    static int default_slots()
+    {
+        long cores = sysconf(_SC_NPROCESSORS_CONF);
+        return cores > 0 ? cores : 1;
+    }
+
+    /* Номер потока, выдаваемый один раз при первом обращении */
+    static int thread_id()
+    {
+        static std::atomic<int> next_id{0};
+        thread_local int id = next_id.fetch_add(1, std::memory_order_relaxed);
+        return id;
+    }
+
+    int slot_index() const
+    {
+        if (mode == PER_CPU)
+        {
+            int cpu = sched_getcpu();
+            if (cpu >= 0)
+                return cpu % shards.size();
+        }
+        return thread_id() % shards.size();
+    }
+
+    Mode mode;
+    long long batch;
+    alignas(CACHE_LINE_SIZE) std::atomic<long long> total{0};
+    std::vector<Shard> shards;
+};
+
+#endif
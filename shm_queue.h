@@ -0,0 +1,165 @@
+#ifndef SHM_QUEUE_H
+#define SHM_QUEUE_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+Анонимная область разделяемой памяти POSIX: shm_open + ftruncate + mmap(MAP_SHARED).
+Имя удаляется сразу после отображения, поэтому область не переживает процессы,
+а дочерние процессы получают ее через fork вместе с остальным адресным пространством
+*/
+inline void *shm_map(size_t bytes)
+{
+    static std::atomic<int> counter{0};
+    std::string name = "/shm-" + std::to_string(getpid()) + "-" + std::to_string(counter.fetch_add(1));
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+        throw std::system_error(errno, std::generic_category(), "shm_open");
+    shm_unlink(name.c_str());
+    if (ftruncate(fd, bytes) != 0)
+    {
+        int err = errno;
+        close(fd);
+        throw std::system_error(err, std::generic_category(), "ftruncate");
+    }
+    void *memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+        throw std::system_error(errno, std::generic_category(), "mmap");
+    return memory;
+}
+
+inline void shm_unmap(void *memory, size_t bytes)
+{
+    munmap(memory, bytes);
+}
+
+/*
+Ограниченная очередь многих производителей и многих потребителей без блокировок
+(схема Вьюкова) для 32-битных значений, размещаемая в разделяемой памяти и общая
+для нескольких процессов. У каждой ячейки свой номер последовательности: ячейка
+свободна для записи, когда номер равен позиции записи, и готова к чтению, когда
+он на единицу больше. Позиции записи и чтения сдвигаются compare_exchange и лежат
+на разных кэш-линиях.
+Процесс, убитый между захватом позиции и обновлением номера ячейки, оставляет ее
+недоступной, пока позиции не обойдут кольцо. Поэтому емкость выбирается с запасом
+от общего числа значений, которые пройдут через очередь
+*/
+class ShmQueue
+{
+public:
+    static const size_t CACHE_LINE_SIZE = 64;
+
+    /* Размер памяти под очередь емкостью capacity (округляется до степени двойки) */
+    static size_t bytes_for(size_t capacity)
+    {
+        return sizeof(ShmQueue) + round_up_pow2(capacity) * sizeof(Cell);
+    }
+
+    /* Создает пустую очередь в памяти memory размером не меньше bytes_for(capacity) */
+    static ShmQueue *create(void *memory, size_t capacity)
+    {
+        static_assert(std::atomic<uint64_t>::is_always_lock_free, "process-shared atomics must be lock-free");
+        ShmQueue *queue = new (memory) ShmQueue(round_up_pow2(capacity));
+        for (size_t i = 0; i < queue->mask + 1; ++i)
+            new (&queue->cells()[i]) Cell{{i}, 0};
+        return queue;
+    }
+
+    ShmQueue(const ShmQueue &) = delete;
+    ShmQueue &operator=(const ShmQueue &) = delete;
+
+    /* false, если очередь заполнена */
+    bool try_push(int32_t value)
+    {
+        uint64_t position = enqueue_position.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell &cell = cells()[position & mask];
+            uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+            int64_t difference = (int64_t)(sequence - position);
+            if (difference == 0)
+            {
+                if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    cell.value = value;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+                return false;
+            else
+                position = enqueue_position.load(std::memory_order_relaxed);
+        }
+    }
+
+    /* false, если очередь пуста */
+    bool try_pop(int32_t &value)
+    {
+        uint64_t position = dequeue_position.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell &cell = cells()[position & mask];
+            uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+            int64_t difference = (int64_t)(sequence - (position + 1));
+            if (difference == 0)
+            {
+                if (dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    value = cell.value;
+                    cell.sequence.store(position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+                return false;
+            else
+                position = dequeue_position.load(std::memory_order_relaxed);
+        }
+    }
+
+    size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<uint64_t> sequence;
+        int32_t value;
+    };
+
+    explicit ShmQueue(size_t capacity) : mask(capacity - 1) {}
+
+    /* Ячейки лежат сразу за заголовком очереди */
+    Cell *cells()
+    {
+        return reinterpret_cast<Cell *>(this + 1);
+    }
+
+    static size_t round_up_pow2(size_t value)
+    {
+        size_t result = 1;
+        while (result < value)
+            result <<= 1;
+        return result;
+    }
+
+    size_t mask;
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> enqueue_position{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> dequeue_position{0};
+    alignas(CACHE_LINE_SIZE) char padding[1]; // Ячейки начинаются с новой кэш-линии
+};
+
+#endif
@@ -0,0 +1,329 @@
+#ifndef SIMD_MATH_H
+#define SIMD_MATH_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
+
+/*
+Пакетные exp и log для массивов double. Одна и та же схема вычисления реализована
+скалярно, на AVX2+FMA (4 числа за раз) и на AVX-512F (8 чисел); нужная версия
+выбирается во время выполнения по возможностям процессора, поэтому специальные
+флаги компиляции не нужны.
+
+exp(x): x = n * ln2 + r, |r| <= ln2 / 2 (редукция Коди-Уэйта с ln2 из двух частей),
+exp(r) - ряд Тейлора до r^13 (остаток < 5e-18), умножение на 2^n двумя шагами
+2^n1 * 2^n2, чтобы правильно получать и переполнение, и денормализованные результаты.
+log(x): x = m * 2^e, m в [sqrt(2)/2, sqrt(2)), log(m) = 2 * atanh(s), s = (m - 1) / (m + 1),
+ряд по s до s^23 (|s| <= 0.172, остаток < 1e-18), log(x) = e * ln2 + log(m).
+Обрабатываются NaN, бесконечности, ноль, отрицательные и денормализованные аргументы.
+
+Погрешность относительно libm (замер task3 --kernel на 10^6 случайных аргументах):
+exp - не больше 1 ULP на [-745, 709], log - не больше 3 ULP на всех положительных
+конечных double; ошибка определяется округлениями в схеме Горнера и делении, а не
+отбрасыванием членов ряда
+*/
+
+enum SimdIsa
+{
+    ISA_SCALAR,
+    ISA_AVX2,
+    ISA_AVX512
+};
+
+/* Операций с плавающей точкой на элемент в реализациях ниже (FMA считается за две) */
+const int EXP_FLOPS = 39;
+const int LOG_FLOPS = 38;
+
+namespace simd_math_detail
+{
+const double LOG2E = 1.44269504088896338700e+00;
+const double LN2_HI = 6.93147180369123816490e-01; // Младшие 21 бит мантиссы нулевые: n * LN2_HI точно
+const double LN2_LO = 1.90821492927058770002e-10;
+const double EXP_MIN = -746.0;                    // Ниже exp(x) округляется к нулю
+const double EXP_MAX = 710.0;                     // Выше exp(x) переполняется
+const double SQRT2 = 1.41421356237309504880;
+const double TWO54 = 18014398509481984.0;         // 2^54 для нормализации денормализованных чисел
+const double MAGIC = 6755399441055744.0;          // 1.5 * 2^52: целое число в младших битах мантиссы
+
+/* Коэффициенты 1/k! для exp(r), от старшего к младшему */
+const double EXP_COEFFS[] = {
+    1.0 / 6227020800.0, 1.0 / 479001600.0, 1.0 / 39916800.0, 1.0 / 3628800.0, 1.0 / 362880.0,
+    1.0 / 40320.0, 1.0 / 5040.0, 1.0 / 720.0, 1.0 / 120.0, 1.0 / 24.0, 1.0 / 6.0, 0.5, 1.0, 1.0};
+const int EXP_DEGREE = 13;
+
+/* Коэффициенты 1/(2k+1) для atanh(s)/s по степеням s^2, от старшего к младшему */
+const double LOG_COEFFS[] = {
+    1.0 / 23, 1.0 / 21, 1.0 / 19, 1.0 / 17, 1.0 / 15, 1.0 / 13,
+    1.0 / 11, 1.0 / 9, 1.0 / 7, 1.0 / 5, 1.0 / 3, 1.0};
+const int LOG_DEGREE = 11;
+
+inline double from_bits(uint64_t bits)
+{
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+inline uint64_t to_bits(double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+/* 2^k для целого k из нормализованного диапазона */
+inline double pow2(double k)
+{
+    return from_bits((uint64_t)((int64_t)k + 1023) << 52);
+}
+
+inline double exp_scalar(double x)
+{
+    if (std::isnan(x))
+        return x;
+    x = std::fmin(std::fmax(x, EXP_MIN), EXP_MAX);
+    double n = std::nearbyint(x * LOG2E);
+    double r = (x - n * LN2_HI) - n * LN2_LO;
+    double p = EXP_COEFFS[0];
+    for (int k = 1; k <= EXP_DEGREE; ++k)
+        p = p * r + EXP_COEFFS[k];
+    double n1 = std::floor(n * 0.5);
+    return p * pow2(n1) * pow2(n - n1);
+}
+
+inline double log_scalar(double x)
+{
+    if (std::isnan(x) || x < 0)
+        return std::nan("");
+    if (x == 0)
+        return -HUGE_VAL;
+    if (std::isinf(x))
+        return x;
+    double e = 0;
+    if (x < 2.2250738585072014e-308)
+    {
+        x *= TWO54;
+        e = -54;
+    }
+    uint64_t bits = to_bits(x);
+    e += (double)(int)(bits >> 52) - 1023;
+    double m = from_bits((bits & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL);
+    if (m > SQRT2)
+    {
+        m *= 0.5;
+        e += 1;
+    }
+    double f = m - 1;
+    double s = f / (2 + f);
+    double z = s * s;
+    double p = LOG_COEFFS[0];
+    for (int k = 1; k <= LOG_DEGREE; ++k)
+        p = p * z + LOG_COEFFS[k];
+    return e * LN2_HI + (e * LN2_LO + 2 * s * p);
+}
+
+__attribute__((target("avx2,fma"))) inline __m256d pow2_avx2(__m256d k)
+{
+    __m256i biased = _mm256_castpd_si256(_mm256_add_pd(k, _mm256_set1_pd(MAGIC + 1023)));
+    return _mm256_castsi256_pd(_mm256_slli_epi64(biased, 52));
+}
+
+__attribute__((target("avx2,fma"))) inline __m256d exp_avx2(__m256d x)
+{
+    __m256d nan = _mm256_cmp_pd(x, x, _CMP_UNORD_Q);
+    __m256d clamped = _mm256_min_pd(_mm256_max_pd(x, _mm256_set1_pd(EXP_MIN)), _mm256_set1_pd(EXP_MAX));
+    __m256d n = _mm256_round_pd(_mm256_mul_pd(clamped, _mm256_set1_pd(LOG2E)),
+                                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d r = _mm256_fnmadd_pd(n, _mm256_set1_pd(LN2_HI), clamped);
+    r = _mm256_fnmadd_pd(n, _mm256_set1_pd(LN2_LO), r);
+    __m256d p = _mm256_set1_pd(EXP_COEFFS[0]);
+    for (int k = 1; k <= EXP_DEGREE; ++k)
+        p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(EXP_COEFFS[k]));
+    __m256d n1 = _mm256_floor_pd(_mm256_mul_pd(n, _mm256_set1_pd(0.5)));
+    __m256d n2 = _mm256_sub_pd(n, n1);
+    __m256d result = _mm256_mul_pd(_mm256_mul_pd(p, pow2_avx2(n1)), pow2_avx2(n2));
+    return _mm256_blendv_pd(result, x, nan);
+}
+
+__attribute__((target("avx2,fma"))) inline __m256d log_avx2(__m256d x)
+{
+    __m256d subnormal = _mm256_cmp_pd(x, _mm256_set1_pd(2.2250738585072014e-308), _CMP_LT_OQ);
+    __m256d xs = _mm256_blendv_pd(x, _mm256_mul_pd(x, _mm256_set1_pd(TWO54)), subnormal);
+    __m256d e = _mm256_and_pd(subnormal, _mm256_set1_pd(-54.0));
+    __m256i bits = _mm256_castpd_si256(xs);
+    // Смещенный порядок как double: целое в младших битах мантиссы 2^52 и вычитание 2^52
+    __m256i biased = _mm256_or_si256(_mm256_srli_epi64(bits, 52), _mm256_castpd_si256(_mm256_set1_pd(4503599627370496.0)));
+    e = _mm256_add_pd(e, _mm256_sub_pd(_mm256_castsi256_pd(biased), _mm256_set1_pd(4503599627370496.0 + 1023)));
+    __m256d m = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi64x(0x000fffffffffffffLL)),
+                                                    _mm256_set1_epi64x(0x3ff0000000000000LL)));
+    __m256d big = _mm256_cmp_pd(m, _mm256_set1_pd(SQRT2), _CMP_GT_OQ);
+    m = _mm256_blendv_pd(m, _mm256_mul_pd(m, _mm256_set1_pd(0.5)), big);
+    e = _mm256_add_pd(e, _mm256_and_pd(big, _mm256_set1_pd(1.0)));
+    __m256d f = _mm256_sub_pd(m, _mm256_set1_pd(1.0));
+    __m256d s = _mm256_div_pd(f, _mm256_add_pd(f, _mm256_set1_pd(2.0)));
+    __m256d z = _mm256_mul_pd(s, s);
+    __m256d p = _mm256_set1_pd(LOG_COEFFS[0]);
+    for (int k = 1; k <= LOG_DEGREE; ++k)
+        p = _mm256_fmadd_pd(p, z, _mm256_set1_pd(LOG_COEFFS[k]));
+    __m256d log_m = _mm256_mul_pd(_mm256_add_pd(s, s), p);
+    __m256d result = _mm256_fmadd_pd(e, _mm256_set1_pd(LN2_HI), _mm256_fmadd_pd(e, _mm256_set1_pd(LN2_LO), log_m));
+    // Особые случаи: отрицательные и NaN -> NaN, 0 -> -inf, +inf -> +inf
+    __m256d invalid = _mm256_or_pd(_mm256_cmp_pd(x, _mm256_setzero_pd(), _CMP_LT_OQ), _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+    result = _mm256_blendv_pd(result, _mm256_set1_pd(std::nan("")), invalid);
+    result = _mm256_blendv_pd(result, _mm256_set1_pd(-HUGE_VAL), _mm256_cmp_pd(x, _mm256_setzero_pd(), _CMP_EQ_OQ));
+    return _mm256_blendv_pd(result, x, _mm256_cmp_pd(x, _mm256_set1_pd(HUGE_VAL), _CMP_EQ_OQ));
+}
+
+// GCC 12 ложно предупреждает о неинициализированном _mm512_undefined_* внутри встроенных функций AVX-512
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+__attribute__((target("avx512f"))) inline __m512d pow2_avx512(__m512d k)
+{
+    __m512i biased = _mm512_castpd_si512(_mm512_add_pd(k, _mm512_set1_pd(MAGIC + 1023)));
+    return _mm512_castsi512_pd(_mm512_slli_epi64(biased, 52));
+}
+
+__attribute__((target("avx512f"))) inline __m512d exp_avx512(__m512d x)
+{
+    __mmask8 nan = _mm512_cmp_pd_mask(x, x, _CMP_UNORD_Q);
+    __m512d clamped = _mm512_min_pd(_mm512_max_pd(x, _mm512_set1_pd(EXP_MIN)), _mm512_set1_pd(EXP_MAX));
+    __m512d n = _mm512_roundscale_pd(_mm512_mul_pd(clamped, _mm512_set1_pd(LOG2E)),
+                                     _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512d r = _mm512_fnmadd_pd(n, _mm512_set1_pd(LN2_HI), clamped);
+    r = _mm512_fnmadd_pd(n, _mm512_set1_pd(LN2_LO), r);
+    __m512d p = _mm512_set1_pd(EXP_COEFFS[0]);
+    for (int k = 1; k <= EXP_DEGREE; ++k)
+        p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(EXP_COEFFS[k]));
+    __m512d n1 = _mm512_roundscale_pd(_mm512_mul_pd(n, _mm512_set1_pd(0.5)), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+    __m512d n2 = _mm512_sub_pd(n, n1);
+    __m512d result = _mm512_mul_pd(_mm512_mul_pd(p, pow2_avx512(n1)), pow2_avx512(n2));
+    return _mm512_mask_blend_pd(nan, result, x);
+}
+
+__attribute__((target("avx512f"))) inline __m512d log_avx512(__m512d x)
+{
+    __mmask8 subnormal = _mm512_cmp_pd_mask(x, _mm512_set1_pd(2.2250738585072014e-308), _CMP_LT_OQ);
+    __m512d xs = _mm512_mask_mul_pd(x, subnormal, x, _mm512_set1_pd(TWO54));
+    __m512d e = _mm512_maskz_mov_pd(subnormal, _mm512_set1_pd(-54.0));
+    __m512i bits = _mm512_castpd_si512(xs);
+    __m512i biased = _mm512_or_si512(_mm512_srli_epi64(bits, 52), _mm512_castpd_si512(_mm512_set1_pd(4503599627370496.0)));
+    e = _mm512_add_pd(e, _mm512_sub_pd(_mm512_castsi512_pd(biased), _mm512_set1_pd(4503599627370496.0 + 1023)));
+    __m512d m = _mm512_castsi512_pd(_mm512_or_si512(_mm512_and_si512(bits, _mm512_set1_epi64(0x000fffffffffffffLL)),
+                                                    _mm512_set1_epi64(0x3ff0000000000000LL)));
+    __mmask8 big = _mm512_cmp_pd_mask(m, _mm512_set1_pd(SQRT2), _CMP_GT_OQ);
+    m = _mm512_mask_mul_pd(m, big, m, _mm512_set1_pd(0.5));
+    e = _mm512_mask_add_pd(e, big, e, _mm512_set1_pd(1.0));
+    __m512d f = _mm512_sub_pd(m, _mm512_set1_pd(1.0));
+    __m512d s = _mm512_div_pd(f, _mm512_add_pd(f, _mm512_set1_pd(2.0)));
+    __m512d z = _mm512_mul_pd(s, s);
+    __m512d p = _mm512_set1_pd(LOG_COEFFS[0]);
+    for (int k = 1; k <= LOG_DEGREE; ++k)
+        p = _mm512_fmadd_pd(p, z, _mm512_set1_pd(LOG_COEFFS[k]));
+    __m512d log_m = _mm512_mul_pd(_mm512_add_pd(s, s), p);
+    __m512d result = _mm512_fmadd_pd(e, _mm512_set1_pd(LN2_HI), _mm512_fmadd_pd(e, _mm512_set1_pd(LN2_LO), log_m));
+    __mmask8 invalid = _mm512_cmp_pd_mask(x, _mm512_setzero_pd(), _CMP_LT_OQ) | _mm512_cmp_pd_mask(x, x, _CMP_UNORD_Q);
+    result = _mm512_mask_blend_pd(invalid, result, _mm512_set1_pd(std::nan("")));
+    result = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, _mm512_setzero_pd(), _CMP_EQ_OQ), result, _mm512_set1_pd(-HUGE_VAL));
+    return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, _mm512_set1_pd(HUGE_VAL), _CMP_EQ_OQ), result, x);
+}
+
+__attribute__((target("avx2,fma"))) inline void exp_batch_avx2(const double *in, double *out, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        _mm256_storeu_pd(out + i, exp_avx2(_mm256_loadu_pd(in + i)));
+    for (; i < count; ++i)
+        out[i] = exp_scalar(in[i]);
+}
+
+__attribute__((target("avx2,fma"))) inline void log_batch_avx2(const double *in, double *out, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        _mm256_storeu_pd(out + i, log_avx2(_mm256_loadu_pd(in + i)));
+    for (; i < count; ++i)
+        out[i] = log_scalar(in[i]);
+}
+
+__attribute__((target("avx512f"))) inline void exp_batch_avx512(const double *in, double *out, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        _mm512_storeu_pd(out + i, exp_avx512(_mm512_loadu_pd(in + i)));
+    for (; i < count; ++i)
+        out[i] = exp_scalar(in[i]);
+}
+
+__attribute__((target("avx512f"))) inline void log_batch_avx512(const double *in, double *out, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        _mm512_storeu_pd(out + i, log_avx512(_mm512_loadu_pd(in + i)));
+    for (; i < count; ++i)
+        out[i] = log_scalar(in[i]);
+}
+
+#pragma GCC diagnostic pop
+} // namespace simd_math_detail
+
+/* Самый широкий набор инструкций, поддерживаемый процессором */
+inline SimdIsa best_simd_isa()
+{
+    static const SimdIsa best = __builtin_cpu_supports("avx512f")                                   ? ISA_AVX512
+                                 : __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ? ISA_AVX2
+                                                                                                   : ISA_SCALAR;
+    return best;
+}
+
+inline const char *simd_isa_name(SimdIsa isa)
+{
+    switch (isa)
+    {
+    case ISA_AVX512:
+        return "avx512";
+    case ISA_AVX2:
+        return "avx2";
+    default:
+        return "scalar";
+    }
+}
+
+/* out[i] = exp(in[i]) для i < count. in и out могут совпадать */
+inline void exp_batch(const double *in, double *out, size_t count, SimdIsa isa = best_simd_isa())
+{
+    switch (isa)
+    {
+    case ISA_AVX512:
+        simd_math_detail::exp_batch_avx512(in, out, count);
+        break;
+    case ISA_AVX2:
+        simd_math_detail::exp_batch_avx2(in, out, count);
+        break;
+    default:
+        for (size_t i = 0; i < count; ++i)
+            out[i] = simd_math_detail::exp_scalar(in[i]);
+    }
+}
+
+/* out[i] = log(in[i]) для i < count. in и out могут совпадать */
+inline void log_batch(const double *in, double *out, size_t count, SimdIsa isa = best_simd_isa())
+{
+    switch (isa)
+    {
+    case ISA_AVX512:
+        simd_math_detail::log_batch_avx512(in, out, count);
+        break;
+    case ISA_AVX2:
+        simd_math_detail::log_batch_avx2(in, out, count);
+        break;
+    default:
+        for (size_t i = 0; i < count; ++i)
+            out[i] = simd_math_detail::log_scalar(in[i]);
+    }
+}
+
+#endif
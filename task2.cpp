@@ -2,8 +2,16 @@
 #include <iostream>
 #include <cstring>
 #include <pthread.h>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <algorithm>
+#include "task_dispenser.h"
+#include "dag_scheduler.h"
+#include "fast_random.h"
 
 using namespace std;
+using namespace std::chrono;
 
 #define err_exit(code, str)                   \
     {                                         \
@@ -13,18 +21,58 @@ using namespace std;
     }
 
 const int TASKS_COUNT = 10;
-int task_list[TASKS_COUNT]; // Массив заданий
-int current_task = 0;       // Указатель на текущее задание
-pthread_mutex_t mutex;      // Мьютекс
+const int THREADS_COUNT = 2;
+int tasks_count = TASKS_COUNT; // Количество заданий
+vector<int> task_list;         // Массив заданий
+int current_task = 0;          // Указатель на текущее задание (раздача под мьютексом)
+pthread_mutex_t task_mutex;    // Мьютекс
+TaskDispenser *dispenser;      // Раздатчик заданий без блокировок
+bool verbose = true;           // Печатать ли выполнение каждого задания
+int task_cost = 0;             // Число итераций работы в одном задании (0 - пустое задание)
+uint64_t seed = 42;            // Зерно генератора заданий: одинаковое зерно дает одинаковые задания
 
-void do_task(int task_no)
+/* Результаты потока на отдельной кэш-линии */
+struct alignas(64) ThreadResult
+{
+    long long sum;  // Сумма по выполненным заданиям, чтобы работу нельзя было выбросить
+    long long done; // Количество выполненных заданий
+};
+
+/* Работа из iterations шагов линейного конгруэнтного генератора */
+long long compute(long long value, long long iterations)
+{
+    for (long long i = 0; i < iterations; ++i)
+    {
+        value = value * 6364136223846793005LL + 1442695040888963407LL;
+    }
+    return value;
+}
+
+void do_task(int task_no, ThreadResult *result)
 {
     /* Сюда необходимо поместить код, выполняющий задание */
-    cout << "Done" << endl;
+    long long value = compute(task_list[task_no], task_cost);
+    result->sum += value;
+    result->done++;
+    if (verbose)
+        cout << "Done" << endl;
 }
 
-void *thread_job(void *arg)
+/* Заполнение массива заданий числами из [0, TASKS_COUNT), воспроизводимыми по зерну */
+void fill_task_list()
+{
+    vector<uint64_t> bits(tasks_count);
+    BulkRandom random(seed);
+    random.fill(bits.data(), bits.size());
+    task_list.resize(tasks_count);
+    for (int i = 0; i < tasks_count; ++i)
+        task_list[i] = (int)(((unsigned __int128)bits[i] * TASKS_COUNT) >> 64);
+}
+
+/* Раздача заданий по одному под мьютексом */
+void *mutex_thread_job(void *arg)
 {
+    ThreadResult *result = static_cast<ThreadResult *>(arg);
     int task_no;
     int err;
     // Перебираем в цикле доступные задания
@@ -33,7 +81,7 @@ void *thread_job(void *arg)
         // Захватываем мьютекс для исключительного доступа
         // к указателю текущего задания (переменная
         // current_task)
-        err = pthread_mutex_lock(&mutex);
+        err = pthread_mutex_lock(&task_mutex);
         if (err != 0)
             err_exit(err, "Cannot lock mutex");
         // Запоминаем номер текущего задания, которое будем исполнять
@@ -41,42 +89,179 @@ void *thread_job(void *arg)
         // Сдвигаем указатель текущего задания на следующее
         current_task++;
         // Освобождаем мьютекс
-        err = pthread_mutex_unlock(&mutex);
+        err = pthread_mutex_unlock(&task_mutex);
         if (err != 0)
             err_exit(err, "Cannot unlock mutex");
         // Если запомненный номер задания не превышает
         // количества заданий, вызываем функцию, которая
         // выполнит задание.
         // В противном случае завершаем работу потока
-        if (task_no < TASKS_COUNT)
-            do_task(task_no);
+        if (task_no < tasks_count)
+            do_task(task_no, result);
         else
             return NULL;
     }
 }
 
-int main()
+/* Раздача заданий порциями через атомарный курсор */
+void *thread_job(void *arg)
+{
+    ThreadResult *result = static_cast<ThreadResult *>(arg);
+    TaskClaimer claimer(*dispenser);
+    int begin, end;
+    // Забираем порции заданий, пока они не закончатся
+    while (claimer.next(begin, end))
+    {
+        for (int task_no = begin; task_no < end; ++task_no)
+            do_task(task_no, result);
+    }
+    return NULL;
+}
+
+/* Выполнение всех заданий threads_count потоками, возвращает время в секундах */
+double run_tasks(void *(*job)(void *), int threads_count, vector<ThreadResult> &results)
+{
+    int err;
+    vector<pthread_t> threads(threads_count);
+    results.assign(threads_count, ThreadResult{0, 0});
+    current_task = 0;
+    TaskDispenser task_dispenser(tasks_count, threads_count);
+    dispenser = &task_dispenser;
+    auto start = steady_clock::now();
+    // Создаём потоки
+    for (int i = 0; i < threads_count; ++i)
+    {
+        err = pthread_create(&threads[i], NULL, job, &results[i]);
+        if (err != 0)
+            err_exit(err, "Cannot create thread");
+    }
+    for (auto &thread : threads)
+        pthread_join(thread, NULL);
+    auto end = steady_clock::now();
+    dispenser = nullptr;
+    return duration<double>(end - start).count();
+}
+
+/* Сравнение раздачи под мьютексом и атомарной раздачи порциями */
+void benchmark(int threads_count)
 {
-    pthread_t thread1, thread2;
-    // Идентификаторы потоков
+    struct Workload
+    {
+        const char *name;
+        int tasks;
+        int cost;
+    };
+    const Workload workloads[] = {
+        {"tiny", 10000000, 0},  // 10^7 пустых заданий: доминирует стоимость раздачи
+        {"large", 64, 2000000}, // Несколько тяжелых заданий: важна равномерность
+    };
+    cout << "workload,dispenser,threads,tasks,seconds,tasks_per_s,tasks_done" << endl;
+    for (const auto &workload : workloads)
+    {
+        tasks_count = workload.tasks;
+        task_cost = workload.cost;
+        fill_task_list();
+        for (bool atomic_dispenser : {false, true})
+        {
+            vector<ThreadResult> results;
+            double seconds = run_tasks(atomic_dispenser ? thread_job : mutex_thread_job, threads_count, results);
+            long long done = 0;
+            for (auto &result : results)
+                done += result.done;
+            cout << workload.name << "," << (atomic_dispenser ? "atomic_batched" : "mutex") << ","
+                 << threads_count << "," << tasks_count << "," << seconds << ","
+                 << (long long)(tasks_count / seconds) << "," << done << endl;
+        }
+    }
+}
+
+/*
+Выполнение заданий как графа зависимостей. Стоимость задания пропорциональна
+task_list[i] + 1, задание i зависит от задания i / 2 (дерево с широким
+параллелизмом), а задания со значением 0 еще и от предыдущего (цепочки)
+*/
+void run_dag(int threads_count)
+{
+    const long long COST_UNIT = 200000; // Шагов работы на единицу стоимости
+    vector<long long> dag_results(tasks_count);
+    DagScheduler scheduler;
+    for (int i = 0; i < tasks_count; ++i)
+    {
+        vector<int> predecessors;
+        if (i > 0)
+            predecessors.push_back(i / 2);
+        if (i > 1 && task_list[i] == 0 && i - 1 != i / 2)
+            predecessors.push_back(i - 1);
+        long long iterations = COST_UNIT * (task_list[i] + 1);
+        auto job = [i, iterations, &dag_results]
+        {
+            dag_results[i] = compute(task_list[i], iterations);
+            if (verbose)
+                cout << "Done" << endl;
+        };
+        scheduler.add_task(job, task_list[i] + 1, predecessors);
+    }
+    scheduler.run(threads_count);
+    double critical_path = scheduler.critical_path();
+    double makespan = scheduler.makespan();
+    double work = scheduler.total_work();
+    // Нижняя граница времени: не меньше критического пути и не меньше работы, деленной на число потоков
+    double lower_bound = max(critical_path, work / threads_count);
+    cout << "tasks,threads,total_work_s,critical_path_s,lower_bound_s,makespan_s,efficiency,steals" << endl;
+    cout << tasks_count << "," << threads_count << "," << work << "," << critical_path << ","
+         << lower_bound << "," << makespan << "," << lower_bound / makespan << "," << scheduler.steals() << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    // Количество потоков и заданий задается аргументами: task2 [threads] [tasks] [--bench | --dag] [--seed n]
+    int threads_count = THREADS_COUNT;
+    bool bench = false;
+    bool dag = false;
+    int positional = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (string(argv[i]) == "--bench")
+            bench = true;
+        else if (string(argv[i]) == "--dag")
+            dag = true;
+        else if (string(argv[i]) == "--seed" && i + 1 < argc)
+            seed = strtoull(argv[++i], NULL, 10);
+        else if (positional++ == 0)
+            threads_count = atoi(argv[i]);
+        else
+            tasks_count = atoi(argv[i]);
+    }
+    if (threads_count < 1 || tasks_count < 0)
+    {
+        cerr << "Usage: " << argv[0] << " [threads] [tasks] [--bench | --dag] [--seed n]" << endl;
+        return EXIT_FAILURE;
+    }
     int err;
-    // Код ошибки
-    // Инициализируем массив заданий случайными числами
-    for (int i = 0; i < TASKS_COUNT; ++i)
-        task_list[i] = rand() % TASKS_COUNT;
     // Инициализируем мьютекс
-    err = pthread_mutex_init(&mutex, NULL);
+    err = pthread_mutex_init(&task_mutex, NULL);
     if (err != 0)
         err_exit(err, "Cannot initialize mutex");
-    // Создаём потоки
-    err = pthread_create(&thread1, NULL, thread_job, NULL);
-    if (err != 0)
-        err_exit(err, "Cannot create thread 1");
-    err = pthread_create(&thread2, NULL, thread_job, NULL);
-    if (err != 0)
-        err_exit(err, "Cannot create thread 2");
-    pthread_join(thread1, NULL);
-    pthread_join(thread2, NULL);
+    if (bench)
+    {
+        verbose = false;
+        benchmark(threads_count);
+    }
+    else
+    {
+        // Инициализируем массив заданий случайными числами
+        fill_task_list();
+        if (dag)
+        {
+            verbose = tasks_count <= TASKS_COUNT;
+            run_dag(threads_count);
+        }
+        else
+        {
+            vector<ThreadResult> results;
+            run_tasks(thread_job, threads_count, results);
+        }
+    }
     // Освобождаем ресурсы, связанные с мьютексом
-    pthread_mutex_destroy(&mutex);
-}
\ No newline at end of file
+    pthread_mutex_destroy(&task_mutex);
+}
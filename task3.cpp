@@ -1,12 +1,24 @@
 #include <cstdlib>
 #include <iostream>
 #include <cstring>
+#include <cerrno>
 #include <pthread.h>
 #include <sstream>
 #include <unistd.h>
 #include <cmath>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <random>
+#include <functional>
+#include <algorithm>
+#include "task_dispenser.h"
+#include "coro_executor.h"
+#include "simd_math.h"
+#include "fast_random.h"
 
 using namespace std;
+using namespace std::chrono;
 
 #define err_exit(code, str)                            \
     {                                                  \
@@ -15,101 +27,414 @@ using namespace std;
     }
 
 const int TASKS_COUNT = 10;
+const int THREADS_COUNT = 2;
 int task_list[TASKS_COUNT];
-// Массив заданий
-int current_task = 0; // Указатель на текущее задание
-// Мьютекс
-pthread_mutex_t mutex;
+uint64_t seed = 42; // Зерно генераторов: у каждого потока свой поток чисел этого зерна
+// Раздатчик заданий: атомарный курсор вместо незащищенного current_task
+TaskDispenser *dispenser;
+// Сумма результатов заданий каждого потока или сопрограммы, по кэш-линии на каждую
+struct alignas(64) JobSum
+{
+    double value;
+};
+vector<JobSum> job_sums;
 // Функция, выполняющая продолжительную операцию
-void do_task(int task_no)
+double do_task(int task_no)
 {
     double result = 0;
     for (int i = 1; i < 10000; i++)
     {
         result += exp(log(i));
     }
+    return result;
 }
+/* Размер задания в пакетном режиме: те же аргументы 1..9999, что и в do_task */
+const int KERNEL_SIZE = 9999;
+
+/* Буферы пакетного вычисления, свои у каждого потока */
+struct KernelBuffers
+{
+    vector<double> input;
+    vector<double> output;
+
+    KernelBuffers() : input(KERNEL_SIZE), output(KERNEL_SIZE)
+    {
+        for (int i = 0; i < KERNEL_SIZE; i++)
+            input[i] = i + 1;
+    }
+};
+
+// То же вычисление пакетами: log и exp над всем массивом векторными инструкциями
+double do_task_batch(int task_no, SimdIsa isa, KernelBuffers &buffers)
+{
+    log_batch(buffers.input.data(), buffers.output.data(), KERNEL_SIZE, isa);
+    exp_batch(buffers.output.data(), buffers.output.data(), KERNEL_SIZE, isa);
+    double result = 0;
+    for (double value : buffers.output)
+        result += value;
+    return result;
+}
+
 // Функция, выполняемая потоком
 void *thread_job(void *arg)
 {
-    int task_no;
-    int err; // Перебираем в цикле доступные задания
+    // Собственный генератор потока: без общего состояния rand() и воспроизводимо по зерну
+    int job_no = (int)(intptr_t)arg;
+    Xoshiro256 random = Xoshiro256::stream(seed, job_no);
+    TaskClaimer claimer(*dispenser);
+    int begin, end;
+    // Перебираем в цикле доступные задания
     while (true)
     {
-        sleep(rand() % 2 + 1);
-        // Захватываем мьютекс для исключительного доступа
-        // к указателю текущего задания (переменная current_task)
-        // err = pthread_mutex_lock(&mutex);
-        if (err != 0)
+        sleep(random.next_below(2) + 1);
+        // Забираем следующую порцию заданий: каждое задание выдается ровно одному потоку.
+        // Если задания закончились, завершаем работу потока
+        if (!claimer.next(begin, end))
         {
-            err_exit(err, "Cannot lock mutex");
+            return NULL;
         }
-        // Запоминаем номер текущего задания, которое будем исполнять
-        task_no = current_task;
-        // Сдвигаем указатель текущего задания на следующее
-        current_task++;
-        // Освобождаем мьютекс
-        // err = pthread_mutex_unlock(&mutex);
-        if (err != 0)
+        for (int task_no = begin; task_no < end; ++task_no)
         {
-            err_exit(err, "Cannot unlock mutex");
+            job_sums[job_no].value += do_task(task_no);
+            cout << pthread_self() << "\t\t\t" << task_no << "\n";
         }
-        // Если запомненный номер задания не превышает
-        // количества заданий, вызываем функцию, которая
-        // выполнит задание.
-        // В противном случае завершаем работу потока
-        if (task_no < TASKS_COUNT)
+    }
+}
+// То же задание в виде сопрограммы: ожидание не занимает поток исполнителя
+AsyncTask coro_job(Executor &executor, unsigned job_no)
+{
+    Xoshiro256 random = Xoshiro256::stream(seed, job_no);
+    TaskClaimer claimer(*dispenser);
+    int begin, end;
+    while (true)
+    {
+        co_await executor.sleep_for(seconds(random.next_below(2) + 1));
+        if (!claimer.next(begin, end))
+        {
+            co_return;
+        }
+        for (int task_no = begin; task_no < end; ++task_no)
         {
-            do_task(task_no);
+            job_sums[job_no].value += do_task(task_no);
             cout << pthread_self() << "\t\t\t" << task_no << "\n";
         }
+    }
+}
+
+/* Задание для сравнения моделей: подождать delay, затем выполнить вычисление */
+struct SleepingTask
+{
+    int task_no;
+    milliseconds delay;
+    double result;
+};
+
+AsyncTask sleeping_coro(Executor &executor, SleepingTask *task)
+{
+    co_await executor.sleep_for(task->delay);
+    task->result = do_task(task->task_no);
+}
+
+void *sleeping_thread(void *arg)
+{
+    SleepingTask *task = static_cast<SleepingTask *>(arg);
+    usleep(duration_cast<microseconds>(task->delay).count());
+    task->result = do_task(task->task_no);
+    return NULL;
+}
+
+/* Модель "поток на задание": возвращает наибольшее число одновременно живых потоков */
+int run_thread_per_job(vector<SleepingTask> &tasks)
+{
+    const size_t STACK_SIZE = 64 * 1024; // Малый стек, чтобы уместить как можно больше потоков
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, STACK_SIZE);
+    vector<pthread_t> threads(tasks.size());
+    size_t oldest = 0; // Самый старый еще не присоединенный поток
+    size_t peak = 0;
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {
+        int err;
+        // При исчерпании лимита потоков ждем завершения самого старого и пробуем снова
+        while ((err = pthread_create(&threads[i], &attr, sleeping_thread, &tasks[i])) == EAGAIN && oldest < i)
+            pthread_join(threads[oldest++], NULL);
+        if (err != 0)
+            err_exit(err, "Cannot create a thread");
+        peak = max(peak, i + 1 - oldest);
+    }
+    for (size_t i = oldest; i < tasks.size(); ++i)
+        pthread_join(threads[i], NULL);
+    pthread_attr_destroy(&attr);
+    return peak;
+}
+
+/*
+Сравнение моделей на tasks_count одновременных заданиях, каждое из которых спит
+от sleep_ms до 2 * sleep_ms, а затем считает: сопрограммы на workers потоках
+исполнителя против отдельного потока на каждое задание
+*/
+void benchmark(int tasks_count, int workers, int sleep_ms)
+{
+    vector<SleepingTask> tasks(tasks_count);
+    Xoshiro256 random(seed);
+    for (int i = 0; i < tasks_count; ++i)
+        tasks[i] = SleepingTask{i, milliseconds(sleep_ms + random.next_below(sleep_ms + 1)), 0};
+    cout << "model,tasks,sleep_ms,os_threads,seconds,tasks_per_s,checksum" << endl;
+    for (bool coroutines : {true, false})
+    {
+        int os_threads;
+        auto start = steady_clock::now();
+        if (coroutines)
+        {
+            Executor executor(workers);
+            for (auto &task : tasks)
+                executor.spawn(sleeping_coro(executor, &task));
+            executor.wait_all();
+            os_threads = workers + 1; // Рабочие потоки и поток-реактор
+        }
         else
+            os_threads = run_thread_per_job(tasks);
+        double elapsed = duration<double>(steady_clock::now() - start).count();
+        double checksum = 0;
+        for (auto &task : tasks)
         {
-            return NULL;
+            checksum += task.result;
+            task.result = 0;
         }
+        cout << (coroutines ? "coroutine" : "thread_per_job") << "," << tasks_count << "," << sleep_ms << ","
+             << os_threads << "," << elapsed << "," << (long long)(tasks_count / elapsed) << "," << checksum << endl;
     }
 }
-int main()
+
+/* Аргументы потока parallel_for */
+struct alignas(64) ParallelForArgs
+{
+    TaskDispenser *dispenser;
+    const function<void(int, int, int)> *body;
+    int thread_no;
+};
+
+void *parallel_for_thread(void *arg)
 {
-    srand(time(0));
+    ParallelForArgs *args = static_cast<ParallelForArgs *>(arg);
+    TaskClaimer claimer(*args->dispenser);
+    int begin, end;
+    while (claimer.next(begin, end))
+        (*args->body)(begin, end, args->thread_no);
+    return NULL;
+}
+
+/* Выполняет body(begin, end, thread_no) над порциями [0, count) на threads_count потоках */
+void parallel_for(int count, int threads_count, const function<void(int, int, int)> &body)
+{
+    TaskDispenser range_dispenser(count, threads_count);
+    vector<pthread_t> threads(threads_count);
+    vector<ParallelForArgs> args(threads_count);
+    for (int i = 0; i < threads_count; i++)
+    {
+        args[i] = ParallelForArgs{&range_dispenser, &body, i};
+        int err = pthread_create(&threads[i], NULL, parallel_for_thread, &args[i]);
+        if (err != 0)
+            err_exit(err, "Cannot create a thread");
+    }
+    for (auto &thread : threads)
+        pthread_join(thread, NULL);
+}
+
+/* Разница в ULP между результатом и эталоном libm */
+double ulp_distance(double value, double reference)
+{
+    if (value == reference || (std::isnan(value) && std::isnan(reference)))
+        return 0;
+    if (std::isnan(value) || std::isnan(reference) || signbit(value) != signbit(reference))
+        return INFINITY;
+    int64_t a, b;
+    memcpy(&a, &value, sizeof(a));
+    memcpy(&b, &reference, sizeof(b));
+    return (double)(a > b ? a - b : b - a);
+}
+
+/* Точность пакетных exp и log относительно libm на случайных аргументах */
+void accuracy_report(const vector<SimdIsa> &isas)
+{
+    const int SAMPLES = 1000000;
+    Xoshiro256 generator(seed);
+    vector<double> exp_args(SAMPLES), log_args(SAMPLES), results(SAMPLES);
+    uniform_real_distribution<double> exp_range(-745.0, 709.0);
+    for (int i = 0; i < SAMPLES; i++)
+    {
+        exp_args[i] = exp_range(generator);
+        // Случайные битовые образы положительных конечных чисел, включая денормализованные
+        uint64_t bits;
+        do
+            bits = generator() & 0x7fffffffffffffffULL;
+        while ((bits >> 52) == 0x7ff);
+        memcpy(&log_args[i], &bits, sizeof(bits));
+    }
+    cout << "function,isa,samples,max_ulp,mean_ulp" << endl;
+    for (SimdIsa isa : isas)
+    {
+        for (bool is_exp : {true, false})
+        {
+            const vector<double> &args = is_exp ? exp_args : log_args;
+            if (is_exp)
+                exp_batch(args.data(), results.data(), SAMPLES, isa);
+            else
+                log_batch(args.data(), results.data(), SAMPLES, isa);
+            double max_ulp = 0, sum_ulp = 0;
+            for (int i = 0; i < SAMPLES; i++)
+            {
+                double ulp = ulp_distance(results[i], is_exp ? exp(args[i]) : log(args[i]));
+                max_ulp = max(max_ulp, ulp);
+                sum_ulp += ulp;
+            }
+            cout << (is_exp ? "exp" : "log") << "," << simd_isa_name(isa) << "," << SAMPLES << ","
+                 << max_ulp << "," << sum_ulp / SAMPLES << endl;
+        }
+    }
+}
+
+/*
+Пакетный режим: tasks_count заданий вида sum(exp(log(i))) раздаются parallel_for
+по threads_count потокам. libm - исходный скалярный do_task, остальные - пакетные
+exp/log. GFLOP/s считается по номинальному числу операций пакетной реализации,
+поэтому у libm, чей код устроен иначе, вместо него выводится n/a
+*/
+void kernel_benchmark(int tasks_count, int threads_count, const string &isa_arg)
+{
+    vector<SimdIsa> isas;
+    SimdIsa best = best_simd_isa();
+    for (SimdIsa isa : {ISA_SCALAR, ISA_AVX2, ISA_AVX512})
+    {
+        // Набор инструкций, которого нет у процессора, не запускаем: его ветви упали бы с SIGILL
+        if ((isa_arg == "all" || isa_arg == simd_isa_name(isa)) && isa <= best)
+            isas.push_back(isa);
+    }
+    bool with_libm = isa_arg == "all" || isa_arg == "libm";
+    if (isas.empty() && !with_libm)
+    {
+        cerr << "Unsupported ISA: " << isa_arg << " (best supported by this CPU: " << simd_isa_name(best) << ")" << endl;
+        exit(EXIT_FAILURE);
+    }
+    accuracy_report(isas);
+    cout << "kernel,isa,threads,tasks,elements,seconds,gelem_s,gflop_s,checksum" << endl;
+    for (int variant = with_libm ? -1 : 0; variant < (int)isas.size(); ++variant)
+    {
+        vector<double> sums(threads_count * 8, 0); // По кэш-линии на поток
+        vector<KernelBuffers> buffers(variant >= 0 ? threads_count : 0);
+        auto start = steady_clock::now();
+        parallel_for(tasks_count, threads_count, [&](int begin, int end, int thread_no) {
+            double sum = 0;
+            for (int task_no = begin; task_no < end; ++task_no)
+                sum += variant < 0 ? do_task(task_no) : do_task_batch(task_no, isas[variant], buffers[thread_no]);
+            sums[thread_no * 8] += sum;
+        });
+        double elapsed = duration<double>(steady_clock::now() - start).count();
+        double checksum = 0;
+        for (double sum : sums)
+            checksum += sum;
+        double elements = (double)tasks_count * KERNEL_SIZE;
+        string gflops = variant < 0 ? "n/a" : to_string(elements * (EXP_FLOPS + LOG_FLOPS) / elapsed / 1e9);
+        cout << "exp_log," << (variant < 0 ? "libm" : simd_isa_name(isas[variant])) << "," << threads_count << ","
+             << tasks_count << "," << (long long)elements << "," << elapsed << "," << elements / elapsed / 1e9 << ","
+             << gflops << "," << checksum << endl;
+    }
+}
+
+/* Сумма результатов всех заданий: без нее вычисление в do_task можно выбросить */
+void print_checksum()
+{
+    double checksum = 0;
+    for (const JobSum &sum : job_sums)
+        checksum += sum.value;
+    cout << "checksum\t\t\t" << checksum << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    // task3 [threads] [--coro] [--bench tasks] [--sleep-ms ms] [--kernel tasks] [--isa name] [--seed n]
+    int threads_count = THREADS_COUNT;
+    bool coro = false;
+    int bench_tasks = 0;
+    int sleep_ms = 1000;
+    int kernel_tasks = 0;
+    string isa = "all";
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--coro")
+            coro = true;
+        else if (arg == "--bench" && i + 1 < argc)
+            bench_tasks = atoi(argv[++i]);
+        else if (arg == "--sleep-ms" && i + 1 < argc)
+            sleep_ms = atoi(argv[++i]);
+        else if (arg == "--kernel" && i + 1 < argc)
+            kernel_tasks = atoi(argv[++i]);
+        else if (arg == "--isa" && i + 1 < argc)
+            isa = argv[++i];
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = strtoull(argv[++i], NULL, 10);
+        else
+            threads_count = atoi(argv[i]);
+    }
+    if (threads_count < 1 || bench_tasks < 0 || sleep_ms < 0 || kernel_tasks < 0)
+    {
+        cerr << "Usage: " << argv[0] << " [threads] [--coro] [--bench tasks] [--sleep-ms ms]"
+             << " [--kernel tasks] [--isa scalar|avx2|avx512|libm|all] [--seed n]" << endl;
+        return EXIT_FAILURE;
+    }
+    if (kernel_tasks > 0)
+    {
+        kernel_benchmark(kernel_tasks, threads_count, isa);
+        return 0;
+    }
+    if (bench_tasks > 0)
+    {
+        benchmark(bench_tasks, threads_count, sleep_ms);
+        return 0;
+    }
     // Идентификаторы потоков
-    pthread_t thread1;
-    pthread_t thread2;
+    vector<pthread_t> threads(threads_count);
     int err; // Код ошибки
     // Инициализируем массив заданий случайными числами
+    Xoshiro256 random(seed);
     for (int i = 0; i < TASKS_COUNT; ++i)
     {
-        task_list[i] = rand() % TASKS_COUNT;
+        task_list[i] = random.next_below(TASKS_COUNT);
     }
     cout << "thread_id\t\t\ttask_no" << endl;
-    // Инициализируем мьютекс
-    err = pthread_mutex_init(&mutex, NULL);
-    if (err != 0)
+    // Инициализируем раздатчик заданий
+    TaskDispenser task_dispenser(TASKS_COUNT, threads_count);
+    dispenser = &task_dispenser;
+    job_sums.assign(threads_count, JobSum{0});
+    if (coro)
     {
-        err_exit(err, "Cannot initialize mutex");
+        // threads_count сопрограмм вместо потоков, все на одном потоке исполнителя
+        Executor executor(1);
+        for (int i = 0; i < threads_count; i++)
+            executor.spawn(coro_job(executor, i));
+        executor.wait_all();
+        print_checksum();
+        return 0;
     }
     // Создаем потоки
-    err = pthread_create(&thread1, NULL, thread_job, NULL);
-    if (err != 0)
-    {
-        err_exit(err, "Cannot create thread 1");
-    }
-    err = pthread_create(&thread2, NULL, thread_job, NULL);
-    if (err != 0)
-    {
-        err_exit(err, "Cannot create thread 2");
-    }
-    err = pthread_join(thread1, NULL);
-    if (err != 0)
+    for (int i = 0; i < threads_count; i++)
     {
-        err_exit(err, "Cannot join a thread 1");
+        err = pthread_create(&threads[i], NULL, thread_job, (void *)(intptr_t)i);
+        if (err != 0)
+        {
+            err_exit(err, "Cannot create a thread");
+        }
     }
-    err = pthread_join(thread2, NULL);
-    if (err != 0)
+    for (int i = 0; i < threads_count; i++)
     {
-        err_exit(err, "Cannot join a thread 2");
+        err = pthread_join(threads[i], NULL);
+        if (err != 0)
+        {
+            err_exit(err, "Cannot join a thread");
+        }
     }
-    // Освобождаем ресурсы, связанные с мьютексом
-    pthread_mutex_destroy(&mutex);
+    print_checksum();
     return 0;
 }
\ No newline at end of file
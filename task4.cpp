@@ -1,149 +1,747 @@
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <pthread.h>
 #include <vector>
 #include <chrono>
 #include <limits>
+#include <new>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <cctype>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include "sharded_counter.h"
+#include "adaptive_lock.h"
+#include "parallel.h"
+#include "perf_counters.h"
 
 using namespace std;
 using namespace std::chrono;
 
-struct ThreadArgs
+#ifdef __cpp_lib_hardware_interference_size
+const size_t CACHE_LINE_SIZE = hardware_destructive_interference_size;
+#else
+const size_t CACHE_LINE_SIZE = 64;
+#endif
+
+/* Общий счетчик на отдельной кэш-линии, чтобы соседние данные не мешали его замеру */
+struct alignas(CACHE_LINE_SIZE) AlignedCounter
+{
+    long long value;
+};
+
+struct alignas(CACHE_LINE_SIZE) ThreadArgs
+{
+    AlignedCounter *counter; // Указатель на общий счетчик
+    void *shared;            // Примитив синхронизации, общий для всех потоков теста
+    int thread_index;        // Номер потока в тесте
+    int count_tasks;         // Количество инкрементов на поток
+    int cs_length;           // Длина критической секции (число итераций холостой работы)
+};
+
+/* Подсказка процессору, что поток крутится в цикле ожидания */
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+/* Холостая работа внутри критической секции, которую компилятор не может выбросить */
+inline void critical_section_work(int cs_length)
+{
+    for (int i = 0; i < cs_length; ++i)
+    {
+        asm volatile("" ::: "memory");
+    }
+}
+
+/*
+Обертки над примитивами синхронизации. Каждый тип предоставляет lock(node)/unlock(node),
+где Node - состояние, которое поток держит у себя на стеке (нужно очередям MCS/CLH,
+для остальных блокировок пустое)
+*/
+struct EmptyNode
+{
+};
+
+struct StdMutexLock
+{
+    typedef EmptyNode Node;
+    std::mutex m;
+    void lock(Node &) { m.lock(); }
+    void unlock(Node &) { m.unlock(); }
+};
+
+template <int MutexType>
+struct PthreadMutexLock
+{
+    typedef EmptyNode Node;
+    pthread_mutex_t mutex;
+    PthreadMutexLock()
+    {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_settype(&attr, MutexType);
+        pthread_mutex_init(&mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+    }
+    ~PthreadMutexLock() { pthread_mutex_destroy(&mutex); }
+    void lock(Node &) { pthread_mutex_lock(&mutex); }
+    void unlock(Node &) { pthread_mutex_unlock(&mutex); }
+};
+
+struct PthreadSpinLock
+{
+    typedef EmptyNode Node;
+    pthread_spinlock_t spinlock;
+    PthreadSpinLock() { pthread_spin_init(&spinlock, PTHREAD_PROCESS_PRIVATE); }
+    ~PthreadSpinLock() { pthread_spin_destroy(&spinlock); }
+    void lock(Node &) { pthread_spin_lock(&spinlock); }
+    void unlock(Node &) { pthread_spin_unlock(&spinlock); }
+};
+
+/* Test-and-test-and-set спинлок с экспоненциальной задержкой после неудачной попытки */
+struct TtasLock
+{
+    typedef EmptyNode Node;
+    static const int MAX_BACKOFF = 1024;
+    atomic<bool> locked{false};
+    void lock(Node &)
+    {
+        int backoff = 1;
+        while (true)
+        {
+            // Ждем чтением, не захватывая линию на запись
+            while (locked.load(memory_order_relaxed))
+                cpu_relax();
+            if (!locked.exchange(true, memory_order_acquire))
+                return;
+            for (int i = 0; i < backoff; ++i)
+                cpu_relax();
+            backoff = min(backoff * 2, MAX_BACKOFF);
+        }
+    }
+    void unlock(Node &) { locked.store(false, memory_order_release); }
+};
+
+/* Билетный спинлок: потоки получают доступ строго в порядке очереди */
+struct TicketLock
+{
+    typedef EmptyNode Node;
+    alignas(CACHE_LINE_SIZE) atomic<unsigned> next_ticket{0};
+    alignas(CACHE_LINE_SIZE) atomic<unsigned> now_serving{0};
+    void lock(Node &)
+    {
+        unsigned ticket = next_ticket.fetch_add(1, memory_order_relaxed);
+        while (now_serving.load(memory_order_acquire) != ticket)
+            cpu_relax();
+    }
+    void unlock(Node &) { now_serving.store(now_serving.load(memory_order_relaxed) + 1, memory_order_release); }
+};
+
+/* Очередь MCS: каждый поток крутится на флаге в собственном узле */
+struct McsLock
+{
+    struct alignas(CACHE_LINE_SIZE) Node
+    {
+        atomic<Node *> next{nullptr};
+        atomic<bool> locked{false};
+    };
+    atomic<Node *> tail{nullptr};
+    void lock(Node &node)
+    {
+        node.next.store(nullptr, memory_order_relaxed);
+        node.locked.store(true, memory_order_relaxed);
+        Node *prev = tail.exchange(&node, memory_order_acq_rel);
+        if (prev == nullptr)
+            return;
+        prev->next.store(&node, memory_order_release);
+        while (node.locked.load(memory_order_acquire))
+            cpu_relax();
+    }
+    void unlock(Node &node)
+    {
+        Node *next = node.next.load(memory_order_acquire);
+        if (next == nullptr)
+        {
+            Node *expected = &node;
+            if (tail.compare_exchange_strong(expected, nullptr, memory_order_acq_rel))
+                return;
+            // Преемник уже встал в очередь, но еще не связал себя с нами
+            while ((next = node.next.load(memory_order_acquire)) == nullptr)
+                cpu_relax();
+        }
+        next->locked.store(false, memory_order_release);
+    }
+};
+
+/*
+Очередь CLH: поток крутится на ячейке предшественника. После освобождения поток
+забирает ячейку предшественника себе, поэтому ячеек всегда на одну больше, чем потоков
+*/
+struct ClhLock
+{
+    struct alignas(CACHE_LINE_SIZE) Cell
+    {
+        atomic<bool> locked{false};
+    };
+    struct Node
+    {
+        Cell *mine = new Cell;
+        Cell *pred = nullptr;
+        ~Node() { delete mine; }
+    };
+    atomic<Cell *> tail{new Cell};
+    ~ClhLock() { delete tail.load(); }
+    void lock(Node &node)
+    {
+        node.mine->locked.store(true, memory_order_relaxed);
+        node.pred = tail.exchange(node.mine, memory_order_acq_rel);
+        while (node.pred->locked.load(memory_order_acquire))
+            cpu_relax();
+    }
+    void unlock(Node &node)
+    {
+        Cell *released = node.mine;
+        node.mine = node.pred;
+        released->locked.store(false, memory_order_release);
+    }
+};
+
+/* Блокировка на futex (Drepper, "Futexes Are Tricky"): 0 - свободна, 1 - захвачена, 2 - есть ожидающие */
+struct FutexLock
 {
-    int *counter;    // Указатель на общий счетчик
-    int count_tasks; // Количество инкрементов на поток
+    typedef EmptyNode Node;
+    atomic<int> state{0};
+    static void futex(atomic<int> *addr, int op, int value)
+    {
+        syscall(SYS_futex, reinterpret_cast<int *>(addr), op, value, nullptr, nullptr, 0);
+    }
+    void lock(Node &)
+    {
+        int c = 0;
+        if (state.compare_exchange_strong(c, 1, memory_order_acquire))
+            return;
+        if (c != 2)
+            c = state.exchange(2, memory_order_acquire);
+        while (c != 0)
+        {
+            futex(&state, FUTEX_WAIT_PRIVATE, 2);
+            c = state.exchange(2, memory_order_acquire);
+        }
+    }
+    void unlock(Node &)
+    {
+        if (state.fetch_sub(1, memory_order_release) != 1)
+        {
+            state.store(0, memory_order_release);
+            futex(&state, FUTEX_WAKE_PRIVATE, 1);
+        }
+    }
 };
 
-pthread_mutex_t mutex;
-pthread_spinlock_t spinlock;
+/* Гибридная блокировка: ожидание в цикле с самонастройкой, затем засыпание на futex */
+struct SpinParkLock
+{
+    typedef EmptyNode Node;
+    AdaptiveLock adaptive;
+    void lock(Node &) { adaptive.lock(); }
+    void unlock(Node &) { adaptive.unlock(); }
+};
 
-/* Функция потока с использованием мьютекса */
-void *mutex_increment(void *arg)
+/* Функция потока, увеличивающая общий счетчик под блокировкой Lock */
+template <typename Lock>
+void *lock_increment(void *arg)
 {
     ThreadArgs *args = static_cast<ThreadArgs *>(arg);
+    Lock *lock = static_cast<Lock *>(args->shared);
+    typename Lock::Node node;
     for (int i = 0; i < args->count_tasks; ++i)
     {
-        pthread_mutex_lock(&mutex);
-        // Захват мьютекса
-        (*(args->counter))++;
-        // Критическая секция
-        pthread_mutex_unlock(&mutex);
-        // Освобождение мьютекса
+        lock->lock(node); // Захват блокировки
+        args->counter->value++;
+        critical_section_work(args->cs_length); // Критическая секция
+        lock->unlock(node); // Освобождение блокировки
     }
     return nullptr;
 }
 
-/* Функция потока с использованием спинлока */
-void *spinlock_increment(void *arg)
+/* Счетчик без блокировки: атомарный fetch_add */
+struct alignas(CACHE_LINE_SIZE) AtomicCounter
+{
+    atomic<long long> value{0};
+};
+
+void *atomic_increment(void *arg)
 {
     ThreadArgs *args = static_cast<ThreadArgs *>(arg);
+    AtomicCounter *counter = static_cast<AtomicCounter *>(args->shared);
     for (int i = 0; i < args->count_tasks; ++i)
     {
-        pthread_spin_lock(&spinlock);   // Захват спинлока
-        (*(args->counter))++;           // Критическая секция
-        pthread_spin_unlock(&spinlock); // Освобождение спинлока
+        counter->value.fetch_add(1, memory_order_relaxed);
+        critical_section_work(args->cs_length);
     }
     return nullptr;
 }
 
-/* Запуск теста с мьютексом */
-double run_mutex_test(int count_threads, int count_tasks, int &final_counter)
+/* Шардированный счетчик: инкременты распределяются по слотам ядер или потоков */
+void *sharded_increment(void *arg)
 {
-    final_counter = 0; // Сброс счетчика перед тестом
-    vector<pthread_t> threads(count_threads);
-    ThreadArgs args = {&final_counter, count_tasks};
-    auto start = high_resolution_clock::now(); // Старт замера
-    // Создание потоков
-    for (int i = 0; i < count_threads; ++i)
+    ThreadArgs *args = static_cast<ThreadArgs *>(arg);
+    ShardedCounter *counter = static_cast<ShardedCounter *>(args->shared);
+    for (int i = 0; i < args->count_tasks; ++i)
     {
-        if (pthread_create(&threads[i], nullptr, mutex_increment, &args) != 0)
-        {
-            cerr << "Error creating thread (mutex test)." << endl;
-            exit(EXIT_FAILURE);
-        }
+        counter->add();
+        critical_section_work(args->cs_length);
     }
-    // Ожидание завершения всех потоков
+    return nullptr;
+}
+
+/*
+Постоянный пул из count_threads участников для замера накладных расходов (--overhead).
+Пулы создаются при первом обращении и живут до конца программы
+*/
+ThreadPool &pool_for(int count_threads)
+{
+    static map<int, unique_ptr<ThreadPool>> pools;
+    unique_ptr<ThreadPool> &pool = pools[count_threads];
+    if (!pool)
+        pool.reset(new ThreadPool(count_threads));
+    return *pool;
+}
+
+/*
+Постоянная команда из count_threads выделенных потоков для замеров блокировок: все
+count_threads потоков стартуют с общего барьера и соперничают за блокировку
+одновременно. Создается при первом обращении, поэтому замер не включает создание потоков
+*/
+ThreadTeam &team_for(int count_threads)
+{
+    static map<int, unique_ptr<ThreadTeam>> teams;
+    unique_ptr<ThreadTeam> &team = teams[count_threads];
+    if (!team)
+        team.reset(new ThreadTeam(count_threads));
+    return *team;
+}
+
+/* Счетчики perf, навешенные на все потоки команды team_for(count_threads) */
+PerfCounters &counters_for(int count_threads)
+{
+    static map<int, unique_ptr<PerfCounters>> counters;
+    unique_ptr<PerfCounters> &perf = counters[count_threads];
+    if (!perf)
+        perf.reset(new PerfCounters(team_for(count_threads).thread_ids()));
+    return *perf;
+}
+
+/*
+Запуск функции теста на count_threads потоках команды и замер времени до завершения
+последнего из них; в sample - счетчики perf за замер, суммарно по потокам команды
+*/
+double run_threads(void *(*thread_func)(void *), void *shared, AlignedCounter *counter,
+                   int count_threads, int count_tasks, int cs_length, PerfSample &sample)
+{
+    vector<ThreadArgs> args(count_threads);
     for (int i = 0; i < count_threads; ++i)
     {
-        pthread_join(threads[i], nullptr);
+        args[i] = {counter, shared, i, count_tasks, cs_length};
     }
+    ThreadTeam &team = team_for(count_threads);
+    PerfCounters &perf = counters_for(count_threads);
+    perf.start();
+    auto start = high_resolution_clock::now(); // Старт замера
+    // Поток команды i выполняет поток теста i
+    team.run([&](int i) { thread_func(&args[i]); });
     auto end = high_resolution_clock::now(); // Финиш замера
+    sample = perf.stop();
     return duration<double>(end - start).count();
 }
-/* Запуск теста со спинлоком */
-double run_spinlock_test(int count_threads, int count_tasks, int &final_counter)
+
+void *empty_thread(void *)
 {
-    final_counter = 0;
-    vector<pthread_t> threads(count_threads);
-    ThreadArgs args = {&final_counter, count_tasks};
-    auto start = high_resolution_clock::now();
-    for (int i = 0; i < count_threads; ++i)
+    return nullptr;
+}
+
+/*
+Накладные расходы одной параллельной области в наносекундах: пустой parallel_for
+по count_threads кускам на постоянном пуле, пустой parallel_reduce, пустой прогон
+команды потоков на барьерах и, для сравнения, создание и ожидание count_threads
+потоков pthread на каждую область
+*/
+void measure_region_overhead(const vector<int> &thread_counts, int regions)
+{
+    cout << "primitive,threads,regions,ns_per_region" << endl;
+    for (int count_threads : thread_counts)
     {
-        if (pthread_create(&threads[i], nullptr, spinlock_increment, &args) != 0)
+        ThreadPool &pool = pool_for(count_threads);
+        auto start = high_resolution_clock::now();
+        for (int r = 0; r < regions; ++r)
+            parallel_for(pool, 0, count_threads, 1, [](int, int) {});
+        double for_ns = duration<double, nano>(high_resolution_clock::now() - start).count() / regions;
+        start = high_resolution_clock::now();
+        long long sum = 0;
+        for (int r = 0; r < regions; ++r)
+            sum += parallel_reduce(pool, 0, count_threads, 1, 0LL, [](int begin, int end) { return (long long)(end - begin); },
+                                   [](long long a, long long b) { return a + b; });
+        double reduce_ns = duration<double, nano>(high_resolution_clock::now() - start).count() / regions;
+        if (sum != (long long)regions * count_threads)
+            cerr << "parallel_reduce returned a wrong sum" << endl;
+        ThreadTeam &team = team_for(count_threads);
+        start = high_resolution_clock::now();
+        for (int r = 0; r < regions; ++r)
+            team.run([](int) {});
+        double team_ns = duration<double, nano>(high_resolution_clock::now() - start).count() / regions;
+        // Создание потоков дороже на порядки, поэтому областей меньше
+        int pthread_regions = max(1, regions / 100);
+        vector<pthread_t> threads(count_threads);
+        start = high_resolution_clock::now();
+        for (int r = 0; r < pthread_regions; ++r)
         {
-            cerr << "Error creating thread (spinlock test)." << endl;
-            exit(EXIT_FAILURE);
+            for (auto &thread : threads)
+            {
+                if (pthread_create(&thread, nullptr, empty_thread, nullptr) != 0)
+                {
+                    cerr << "Error creating thread." << endl;
+                    exit(EXIT_FAILURE);
+                }
+            }
+            for (auto &thread : threads)
+                pthread_join(thread, nullptr);
         }
+        double pthread_ns = duration<double, nano>(high_resolution_clock::now() - start).count() / pthread_regions;
+        cout << setprecision(0);
+        cout << "pool_parallel_for," << count_threads << "," << regions << "," << for_ns << endl;
+        cout << "pool_parallel_reduce," << count_threads << "," << regions << "," << reduce_ns << endl;
+        cout << "team_barrier_run," << count_threads << "," << regions << "," << team_ns << endl;
+        cout << "pthread_create_join," << count_threads << "," << pthread_regions << "," << pthread_ns << endl;
     }
-    for (int i = 0; i < count_threads; ++i)
+}
+
+/* Запуск теста с блокировкой Lock */
+template <typename Lock>
+double run_lock_test(int count_threads, int count_tasks, int cs_length, long long &final_counter,
+                     PerfSample &sample)
+{
+    Lock lock;
+    AlignedCounter counter = {0}; // Сброс счетчика перед тестом
+    double time = run_threads(lock_increment<Lock>, &lock, &counter, count_threads, count_tasks, cs_length, sample);
+    final_counter = counter.value;
+    return time;
+}
+
+/* Запуск теста с атомарным счетчиком */
+double run_atomic_test(int count_threads, int count_tasks, int cs_length, long long &final_counter,
+                     PerfSample &sample)
+{
+    AtomicCounter counter;
+    double time = run_threads(atomic_increment, &counter, nullptr, count_threads, count_tasks, cs_length, sample);
+    final_counter = counter.value.load();
+    return time;
+}
+
+/* Запуск теста с шардированным счетчиком: по слоту на ядро либо на поток */
+template <ShardedCounter::Mode Mode>
+double run_sharded_test(int count_threads, int count_tasks, int cs_length, long long &final_counter,
+                     PerfSample &sample)
+{
+    ShardedCounter counter(Mode, 1024, Mode == ShardedCounter::PER_THREAD ? count_threads : 0);
+    double time = run_threads(sharded_increment, &counter, nullptr, count_threads, count_tasks, cs_length, sample);
+    final_counter = counter.read_exact();
+    return time;
+}
+
+/* Описание одного участника сравнения */
+struct LockBenchmark
+{
+    const char *name;
+    double (*run)(int count_threads, int count_tasks, int cs_length, long long &final_counter, PerfSample &sample);
+    bool fifo_spin = false; // Справедливый спинлок: при потоках больше ядер очередь стоит за вытесненным владельцем
+};
+
+const LockBenchmark LOCK_BENCHMARKS[] = {
+    {"std_mutex", run_lock_test<StdMutexLock>},
+    {"pthread_mutex", run_lock_test<PthreadMutexLock<PTHREAD_MUTEX_NORMAL>>},
+    {"pthread_mutex_adaptive", run_lock_test<PthreadMutexLock<PTHREAD_MUTEX_ADAPTIVE_NP>>},
+    {"pthread_spinlock", run_lock_test<PthreadSpinLock>},
+    {"ttas_backoff", run_lock_test<TtasLock>},
+    {"ticket", run_lock_test<TicketLock>, true},
+    {"mcs", run_lock_test<McsLock>, true},
+    {"clh", run_lock_test<ClhLock>, true},
+    {"futex", run_lock_test<FutexLock>},
+    {"spin_park", run_lock_test<SpinParkLock>},
+    {"atomic_fetch_add", run_atomic_test},
+    {"sharded_per_cpu", run_sharded_test<ShardedCounter::PER_CPU>},
+    {"sharded_per_thread", run_sharded_test<ShardedCounter::PER_THREAD>},
+};
+
+/* Параметры запуска, задаваемые аргументами командной строки или JSON-файлом */
+struct BenchmarkConfig
+{
+    vector<int> threads;               // Перебираемые количества потоков (по умолчанию степени двойки до числа ядер)
+    vector<int> cs_lengths = {0, 100}; // Перебираемые длины критической секции
+    vector<string> locks;              // Участники сравнения (пусто - все)
+    int count_tasks = 100000;          // Количество инкрементов на поток
+    int runs = 20;                     // Количество замеров каждой конфигурации
+    int oversubscribe = 0;             // Тест вытеснения владельца: добавить 2x..Nx от числа ядер
+    int overhead_regions = 0;          // Замер накладных расходов параллельной области вместо блокировок
+};
+
+long online_cores()
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? cores : 1;
+}
+
+/*
+Степени двойки до числа онлайн-ядер. Справедливые спинлоки (ticket, MCS, CLH) при
+числе потоков больше числа ядер вырождаются: очередь стоит, пока вытесненный
+владелец не получит квант, поэтому такие точки задаются явно через --threads
+или --oversubscribe
+*/
+vector<int> default_thread_counts()
+{
+    long cores = online_cores();
+    vector<int> threads;
+    for (int n = 1; n <= max(1L, cores); n *= 2)
+        threads.push_back(n);
+    if (threads.back() != cores && cores > 1)
+        threads.push_back(cores);
+    return threads;
+}
+
+vector<int> parse_int_list(const string &text)
+{
+    vector<int> values;
+    stringstream stream(text);
+    string item;
+    while (getline(stream, item, ','))
     {
-        pthread_join(threads[i], nullptr);
+        if (!item.empty())
+            values.push_back(atoi(item.c_str()));
     }
-    auto end = high_resolution_clock::now();
-    return duration<double>(end - start).count();
+    return values;
+}
+
+vector<string> parse_string_list(const string &text)
+{
+    vector<string> values;
+    stringstream stream(text);
+    string item;
+    while (getline(stream, item, ','))
+    {
+        if (!item.empty())
+            values.push_back(item);
+    }
+    return values;
 }
-int main()
-{
-    int count_threads, count_tasks;
-    char repeat;
-    // Инициализация примитивов синхронизации
-    pthread_mutex_init(&mutex, nullptr);
-    pthread_spin_init(&spinlock, PTHREAD_PROCESS_PRIVATE);
-    do
-    {
-        cout << "Enter count of threads: ";
-        cin >> count_threads;
-        cout << "Enter count of tasks per thread: ";
-        cin >> count_tasks;
-        // Тестирование мьютекса (100 замеров)
-        double min_mutex_time = numeric_limits<double>::max();
-        int mutex_counter = 0;
-        for (int i = 0; i < 100; ++i)
+
+/*
+Разбор плоского JSON-объекта вида {"threads": [1, 2], "locks": ["mcs"], "runs": 10}.
+Значения-массивы приводятся к строке через запятую и разбираются теми же функциями,
+что и аргументы командной строки
+*/
+bool load_json_config(const string &path, BenchmarkConfig &config)
+{
+    ifstream file(path);
+    if (!file)
+    {
+        cerr << "Cannot open config " << path << endl;
+        return false;
+    }
+    string text((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    size_t pos = 0;
+    while ((pos = text.find('"', pos)) != string::npos)
+    {
+        size_t key_end = text.find('"', pos + 1);
+        if (key_end == string::npos)
+            break;
+        string key = text.substr(pos + 1, key_end - pos - 1);
+        size_t colon = text.find(':', key_end);
+        if (colon == string::npos)
+            break;
+        // Значение тянется до конца массива либо до запятой/закрывающей скобки
+        size_t value_begin = text.find_first_not_of(" \t\r\n", colon + 1);
+        if (value_begin == string::npos)
+            break;
+        size_t value_end = text[value_begin] == '['
+                               ? text.find(']', value_begin)
+                               : text.find_first_of(",}", value_begin);
+        if (value_end == string::npos)
+        {
+            cerr << "Unterminated value of " << key << " in config " << path << endl;
+            return false;
+        }
+        if (text[value_begin] == '[')
+            ++value_end;
+        string raw = text.substr(value_begin, value_end - value_begin);
+        string value;
+        for (char c : raw)
         {
-            int current_counter;
-            double current_time = run_mutex_test(count_threads, count_tasks, current_counter);
+            if (!isspace(static_cast<unsigned char>(c)) && c != '"' && c != '[' && c != ']')
+                value += c;
+        }
+        if (key == "threads")
+            config.threads = parse_int_list(value);
+        else if (key == "cs")
+            config.cs_lengths = parse_int_list(value);
+        else if (key == "locks")
+            config.locks = parse_string_list(value);
+        else if (key == "tasks")
+            config.count_tasks = atoi(value.c_str());
+        else if (key == "runs")
+            config.runs = atoi(value.c_str());
+        else if (key == "oversubscribe")
+            config.oversubscribe = atoi(value.c_str());
+        else
+            cerr << "Unknown config key " << key << endl;
+        pos = value_end;
+    }
+    return true;
+}
 
-            // Сохраняем минимальное время и соответствующий счетчик
-            if (current_time < min_mutex_time)
-            {
-                min_mutex_time = current_time;
-                mutex_counter = current_counter;
-            }
+void print_usage(const char *program)
+{
+    cerr << "Usage: " << program
+         << " [--config file.json] [--threads 1,2,4] [--cs 0,100] [--tasks N] [--runs N] [--locks name,...]\n"
+         << "       [--oversubscribe N]  add 2x..Nx online cores threads (lock-holder preemption test)\n"
+         << "       [--overhead N]       measure ns per parallel region over N empty regions instead\n"
+         << "Locks:";
+    for (const auto &benchmark : LOCK_BENCHMARKS)
+        cerr << " " << benchmark.name;
+    cerr << endl;
+}
+
+bool parse_args(int argc, char *argv[], BenchmarkConfig &config)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (i + 1 >= argc)
+            return false;
+        string value = argv[++i];
+        if (arg == "--config")
+        {
+            if (!load_json_config(value, config))
+                return false;
         }
-        // Тестирование спинлока (100 замеров)
-        double min_spinlock_time = numeric_limits<double>::max();
-        int spinlock_counter = 0;
-        for (int i = 0; i < 100; ++i)
+        else if (arg == "--threads")
+            config.threads = parse_int_list(value);
+        else if (arg == "--cs")
+            config.cs_lengths = parse_int_list(value);
+        else if (arg == "--tasks")
+            config.count_tasks = atoi(value.c_str());
+        else if (arg == "--runs")
+            config.runs = atoi(value.c_str());
+        else if (arg == "--locks")
+            config.locks = parse_string_list(value);
+        else if (arg == "--oversubscribe")
+            config.oversubscribe = atoi(value.c_str());
+        else if (arg == "--overhead")
+            config.overhead_regions = atoi(value.c_str());
+        else
+            return false;
+    }
+    // Число потоков меньше 1 (в том числе из JSON-файла) - ошибка аргументов, а не пустой замер
+    bool threads_valid = !config.threads.empty() &&
+                         all_of(config.threads.begin(), config.threads.end(), [](int threads) { return threads >= 1; });
+    return threads_valid && config.count_tasks > 0 && config.runs > 0;
+}
+
+/* Медиана события на одну операцию, n/a если счетчик недоступен */
+string format_per_op(const vector<PerfSample> &samples, PerfEvent event, long long ops)
+{
+    double median = median_event(samples, event);
+    if (median < 0)
+        return "n/a";
+    ostringstream out;
+    out << fixed << setprecision(3) << median / ops;
+    return out.str();
+}
+
+/* Медиана события на замер, n/a если счетчик недоступен */
+string format_per_run(const vector<PerfSample> &samples, PerfEvent event)
+{
+    double median = median_event(samples, event);
+    return median < 0 ? "n/a" : to_string((long long)median);
+}
+
+int main(int argc, char *argv[])
+{
+    BenchmarkConfig config;
+    config.threads = default_thread_counts();
+    if (!parse_args(argc, argv, config))
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    long cores = online_cores();
+    for (int factor = 2; factor <= config.oversubscribe; ++factor)
+    {
+        config.threads.push_back(factor * cores);
+    }
+    cout << fixed;
+    if (config.overhead_regions > 0)
+    {
+        measure_region_overhead(config.threads, config.overhead_regions);
+        return 0;
+    }
+    cout << "lock,threads,cs_length,tasks_per_thread,runs,median_s,mad_s,p99_s,throughput_ops_s,counter_ok,"
+            "cycles_per_op,instructions_per_op,llc_misses_per_op,branch_misses_per_op,context_switches,migrations"
+         << endl;
+    for (const auto &benchmark : LOCK_BENCHMARKS)
+    {
+        if (!config.locks.empty() &&
+            find(config.locks.begin(), config.locks.end(), benchmark.name) == config.locks.end())
+            continue;
+        for (int count_threads : config.threads)
         {
-            int current_counter;
-            double current_time = run_spinlock_test(count_threads, count_tasks, current_counter);
-            if (current_time < min_spinlock_time)
+            // Справедливые спинлоки при переподписке запускаются только по явному запросу
+            if (benchmark.fifo_spin && count_threads > cores && config.locks.empty())
             {
-                min_spinlock_time = current_time;
-                spinlock_counter = current_counter;
+                cerr << "Skipping " << benchmark.name << " with " << count_threads
+                     << " threads on " << cores << " cores (use --locks to force)" << endl;
+                continue;
+            }
+            for (int cs_length : config.cs_lengths)
+            {
+                vector<double> times;
+                vector<PerfSample> samples;
+                bool counter_ok = true;
+                long long expected = static_cast<long long>(count_threads) * config.count_tasks;
+                for (int i = 0; i < config.runs; ++i)
+                {
+                    long long final_counter;
+                    PerfSample sample;
+                    times.push_back(benchmark.run(count_threads, config.count_tasks, cs_length, final_counter, sample));
+                    samples.push_back(sample);
+                    counter_ok = counter_ok && final_counter == expected;
+                }
+                SampleStats stats = summarize(times);
+                cout << benchmark.name << "," << count_threads << "," << cs_length << ","
+                     << config.count_tasks << "," << config.runs << ","
+                     << setprecision(9) << stats.median << "," << stats.mad << "," << stats.p99 << ","
+                     << setprecision(0) << expected / stats.median << ","
+                     << (counter_ok ? "yes" : "no") << ","
+                     << format_per_op(samples, PERF_CYCLES, expected) << ","
+                     << format_per_op(samples, PERF_INSTRUCTIONS, expected) << ","
+                     << format_per_op(samples, PERF_LLC_MISSES, expected) << ","
+                     << format_per_op(samples, PERF_BRANCH_MISSES, expected) << ","
+                     << format_per_run(samples, PERF_CONTEXT_SWITCHES) << ","
+                     << format_per_run(samples, PERF_MIGRATIONS) << endl;
             }
         }
-
-        cout << fixed;
-        // Вывод результатов
-        cout << "Mutex test result: min time = " << min_mutex_time
-             << " seconds, final counter = " << mutex_counter << endl;
-        cout << "Spinlock test result: min time = " << min_spinlock_time
-             << " seconds, final counter = " << spinlock_counter << endl;
-        cout << "Run test again? (y/n): ";
-        cin >> repeat;
-    } while (repeat == 'y' || repeat == 'Y');
-    // Освобождение ресурсов примитивов
-    pthread_mutex_destroy(&mutex);
-    pthread_spin_destroy(&spinlock);
+    }
     return 0;
-}
\ No newline at end of file
+}
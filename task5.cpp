@@ -3,8 +3,20 @@
 #include <cstdlib>
 #include <cstring>
 #include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <sched.h>
+#include "channel.h"
+#include "spsc_ring.h"
+#include "object_pool.h"
 
 using namespace std;
+using namespace std::chrono;
 
 #define err_exit(code, str)                            \
     {                                                  \
@@ -14,17 +26,54 @@ using namespace std;
 
 #define NUM_PRODUCTS 10
 
-pthread_mutex_t mutex;
+pthread_mutex_t product_mutex;     // Мьютекс исходной схемы передачи
 int products_count = NUM_PRODUCTS; // Количество продуктов, которые осталось произвести и потребить
 bool product_ready = false;        // Флаг готовности продукта
+bool verbose = true;               // Печатать ли каждый произведенный и потребленный продукт
+
+/* Продукт, передаваемый от производителя потребителю */
+struct Product
+{
+    int number;                           // Номер продукта
+    steady_clock::time_point produced_at; // Момент производства, для замера задержки передачи
+};
+
+/*
+Счетчик обращений к куче через operator new: позволяет проверить, что в
+установившемся режиме передача продуктов через пул не выделяет память
+*/
+atomic<long long> heap_allocations{0};
+
+void *operator new(size_t size)
+{
+    heap_allocations.fetch_add(1, memory_order_relaxed);
+    if (void *memory = malloc(size))
+        return memory;
+    throw bad_alloc();
+}
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+steady_clock::time_point legacy_produced_at; // Момент производства текущего продукта (исходная схема)
+vector<double> legacy_latencies;             // Задержки передачи в исходной схеме, мкс
+
 /* Функция, выполняемая потомком-производителем */
 void *producer_func(void *arg)
 {
     int err;
+    int total = products_count;
     while (true)
     {
         // Захватываем мьютекс
-        err = pthread_mutex_lock(&mutex);
+        err = pthread_mutex_lock(&product_mutex);
         if (err != 0)
         {
             err_exit(err, "Cannot lock mutex");
@@ -33,14 +82,14 @@ void *producer_func(void *arg)
         while (product_ready && products_count > 0)
         {
             // Освобождаем мьютекс, чтобы другой поток мог его захватить
-            err = pthread_mutex_unlock(&mutex);
+            err = pthread_mutex_unlock(&product_mutex);
             if (err != 0)
             {
                 err_exit(err, "Cannot unlock mutex");
             }
             sleep(1);
             // Захватываем мьютекс
-            err = pthread_mutex_lock(&mutex);
+            err = pthread_mutex_lock(&product_mutex);
             if (err != 0)
             {
                 err_exit(err, "Cannot lock mutex");
@@ -50,14 +99,16 @@ void *producer_func(void *arg)
         if (products_count > 0)
         {
             // Производим товар
-            cout << "Produced product #" << NUM_PRODUCTS - products_count + 1 << endl;
+            if (verbose)
+                cout << "Produced product #" << total - products_count + 1 << endl;
+            legacy_produced_at = steady_clock::now();
             product_ready = true;
             // Уменьшаем количество товаров, которые осталось произвести
             products_count--;
         } // Обеспечиваем своевременное завершение потока-производителя
         else if (products_count == 0)
         {
-            err = pthread_mutex_unlock(&mutex);
+            err = pthread_mutex_unlock(&product_mutex);
             if (err != 0)
             {
                 err_exit(err, "Cannot unlock mutex");
@@ -65,7 +116,7 @@ void *producer_func(void *arg)
             return NULL;
         }
         // Освобождаем мьютекс
-        err = pthread_mutex_unlock(&mutex);
+        err = pthread_mutex_unlock(&product_mutex);
         if (err != 0)
         {
             err_exit(err, "Cannot unlock mutex");
@@ -76,9 +127,10 @@ void *producer_func(void *arg)
 void *consumer_func(void *arg)
 {
     int err;
+    int total = products_count;
     while (true)
     {
-        err = pthread_mutex_lock(&mutex);
+        err = pthread_mutex_lock(&product_mutex);
         if (err != 0)
         {
             err_exit(err, "Cannot lock mutex");
@@ -87,14 +139,14 @@ void *consumer_func(void *arg)
         while (!product_ready && products_count > 0)
         {
             // Освобождаем мьютекс, чтобы другой поток мог его захватить
-            err = pthread_mutex_unlock(&mutex);
+            err = pthread_mutex_unlock(&product_mutex);
             if (err != 0)
             {
                 err_exit(err, "Cannot unlock mutex");
             }
             sleep(1);
             // Захватываем мьютекс
-            err = pthread_mutex_lock(&mutex);
+            err = pthread_mutex_lock(&product_mutex);
             if (err != 0)
             {
                 err_exit(err, "Cannot lock mutex");
@@ -104,14 +156,16 @@ void *consumer_func(void *arg)
         if (product_ready)
         {
             // Потребляем товар
-            cout << "Consumed product #" << NUM_PRODUCTS - products_count << endl
-                 << endl;
+            legacy_latencies.push_back(duration<double, micro>(steady_clock::now() - legacy_produced_at).count());
+            if (verbose)
+                cout << "Consumed product #" << total - products_count << endl
+                     << endl;
             // Указываем, что товар потреблен
             product_ready = false;
         }
         else
         {
-            err = pthread_mutex_unlock(&mutex);
+            err = pthread_mutex_unlock(&product_mutex);
             if (err != 0)
             {
                 err_exit(err, "Cannot unlock mutex");
@@ -119,7 +173,7 @@ void *consumer_func(void *arg)
             return NULL;
         }
         // Освобождаем мьютекс
-        err = pthread_mutex_unlock(&mutex);
+        err = pthread_mutex_unlock(&product_mutex);
         if (err != 0)
         {
             err_exit(err, "Cannot unlock mutex");
@@ -127,16 +181,77 @@ void *consumer_func(void *arg)
     }
 }
 
-int main()
+/* Параметры запуска */
+struct Config
+{
+    string mode = "channel";  // Схема передачи: legacy, channel, spsc, pool, alloc или all
+    int producers = 1;        // Количество производителей
+    int consumers = 1;        // Количество потребителей
+    int items = NUM_PRODUCTS; // Количество продуктов
+    int legacy_items = 5;     // Количество продуктов для исходной схемы в режиме замера (около секунды на продукт)
+    int capacity = 64;        // Емкость канала
+    int batch = 1;            // Размер пачки push_n/pop_n
+    int spin = 1024;          // Итераций ожидания в цикле перед засыпанием (spsc), -1 - не засыпать и не платить за барьер в каждом push/pop
+    vector<int> payloads = {4096}; // Размеры продукта в байтах для схем pool и alloc
+    bool pin = false;         // Закрепить потоки за разными ядрами (замер межъядерной задержки)
+    bool bench = false;       // Режим замера: без печати продуктов, итог в CSV
+};
+
+/*
+Задержка замеряется на каждом latency_sample-м продукте: при 10^8 продуктов
+хранить и засекать время каждого слишком дорого
+*/
+int latency_sample = 1;
+
+/* Результат одного прогона */
+struct RunResult
+{
+    double seconds;           // Время от старта до завершения всех потоков
+    long long items;          // Количество переданных продуктов
+    vector<double> latencies; // Задержки передачи замеренных продуктов, мкс
+    long long allocations;    // Обращений к куче за время передачи
+};
+
+/* Отметка времени производства для продуктов, на которых замеряется задержка */
+steady_clock::time_point production_stamp(int number)
+{
+    return number % latency_sample == 0 ? steady_clock::now() : steady_clock::time_point();
+}
+
+/* Задержка передачи продукта, если он был отмечен при производстве */
+void record_latency(const Product &product, steady_clock::time_point now, vector<double> &latencies)
+{
+    if (product.produced_at != steady_clock::time_point())
+        latencies.push_back(duration<double, micro>(now - product.produced_at).count());
+}
+
+/* Закрепление потока за ядром index по модулю числа ядер */
+void pin_thread(pthread_t thread, int index)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(index % max(1L, cores), &set);
+    pthread_setaffinity_np(thread, sizeof(set), &set);
+}
+
+/* Запуск исходной схемы: один производитель, один потребитель, флаг product_ready */
+RunResult run_legacy(int items)
 {
     pthread_t thread1, thread2;
     int err;
+    products_count = items;
+    product_ready = false;
+    legacy_latencies.clear();
+    legacy_latencies.reserve(items);
     // Инициализируем мьютекс
-    err = pthread_mutex_init(&mutex, NULL);
+    err = pthread_mutex_init(&product_mutex, NULL);
     if (err != 0)
     {
         err_exit(err, "Cannot initialize mutex");
     }
+    long long allocations = heap_allocations.load();
+    auto start = steady_clock::now();
     // Создаем потоки
     err = pthread_create(&thread1, NULL, producer_func, NULL);
     if (err != 0)
@@ -159,7 +274,476 @@ int main()
     {
         err_exit(err, "Cannot join the consumer thread");
     }
+    auto end = steady_clock::now();
     // Освобождаем ресурсы, связанные с мьютексом
-    pthread_mutex_destroy(&mutex);
+    pthread_mutex_destroy(&product_mutex);
+    allocations = heap_allocations.load() - allocations;
+    return {duration<double>(end - start).count(), (long long)legacy_latencies.size(), legacy_latencies, allocations};
+}
+
+/* Общие данные производителей и потребителей канала */
+struct ChannelShared
+{
+    BoundedChannel<Product> *channel;
+    atomic<int> next_number{1};    // Номер следующего производимого продукта
+    atomic<int> producers_left{0}; // Производители, которые еще не закончили работу
+    pthread_mutex_t output_mutex;  // Мьютекс для вывода
+    int items;
+    int batch;
+};
+
+struct ChannelThreadArgs
+{
+    ChannelShared *shared;
+    vector<double> latencies; // Задержки, замеренные потребителем
+};
+
+/* Производитель: берет номера продуктов из общего счетчика и отправляет их пачками */
+void *channel_producer_func(void *arg)
+{
+    ChannelThreadArgs *args = static_cast<ChannelThreadArgs *>(arg);
+    ChannelShared *shared = args->shared;
+    vector<Product> batch;
+    batch.reserve(shared->batch);
+    while (true)
+    {
+        int number = shared->next_number.fetch_add(1, memory_order_relaxed);
+        if (number <= shared->items)
+        {
+            batch.push_back({number, production_stamp(number)});
+            if (verbose)
+            {
+                pthread_mutex_lock(&shared->output_mutex);
+                cout << "Produced product #" << number << endl;
+                pthread_mutex_unlock(&shared->output_mutex);
+            }
+        }
+        bool last = number >= shared->items;
+        if (!batch.empty() && ((int)batch.size() == shared->batch || last))
+        {
+            shared->channel->push_n(batch.data(), batch.size());
+            batch.clear();
+        }
+        if (last)
+            break;
+    }
+    // Последний завершившийся производитель закрывает канал
+    if (shared->producers_left.fetch_sub(1, memory_order_acq_rel) == 1)
+        shared->channel->close();
+    return NULL;
+}
+
+/* Потребитель: забирает продукты пачками, пока канал не закрыт и не опустел */
+void *channel_consumer_func(void *arg)
+{
+    ChannelThreadArgs *args = static_cast<ChannelThreadArgs *>(arg);
+    ChannelShared *shared = args->shared;
+    vector<Product> batch(shared->batch);
+    size_t count;
+    while ((count = shared->channel->pop_n(batch.data(), batch.size())) > 0)
+    {
+        auto now = steady_clock::now();
+        for (size_t i = 0; i < count; ++i)
+        {
+            record_latency(batch[i], now, args->latencies);
+            if (verbose)
+            {
+                pthread_mutex_lock(&shared->output_mutex);
+                cout << "Consumed product #" << batch[i].number << endl
+                     << endl;
+                pthread_mutex_unlock(&shared->output_mutex);
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Запуск схемы с ограниченным каналом: M производителей, N потребителей */
+RunResult run_channel(const Config &config)
+{
+    BoundedChannel<Product> channel(config.capacity);
+    ChannelShared shared;
+    shared.channel = &channel;
+    shared.producers_left = config.producers;
+    shared.items = config.items;
+    shared.batch = max(1, config.batch);
+    int err = pthread_mutex_init(&shared.output_mutex, NULL);
+    if (err != 0)
+    {
+        err_exit(err, "Cannot initialize mutex");
+    }
+    vector<pthread_t> threads(config.producers + config.consumers);
+    vector<ChannelThreadArgs> args(threads.size());
+    for (auto &arg : args)
+    {
+        arg.latencies.reserve(config.items / latency_sample + 1);
+    }
+    long long allocations = heap_allocations.load();
+    auto start = steady_clock::now();
+    for (size_t i = 0; i < threads.size(); ++i)
+    {
+        args[i].shared = &shared;
+        bool producer = (int)i < config.producers;
+        err = pthread_create(&threads[i], NULL, producer ? channel_producer_func : channel_consumer_func, &args[i]);
+        if (err != 0)
+        {
+            err_exit(err, "Cannot create a producer or consumer thread");
+        }
+        if (config.pin)
+            pin_thread(threads[i], i);
+    }
+    for (auto &thread : threads)
+    {
+        err = pthread_join(thread, NULL);
+        if (err != 0)
+        {
+            err_exit(err, "Cannot join a thread");
+        }
+    }
+    auto end = steady_clock::now();
+    allocations = heap_allocations.load() - allocations;
+    pthread_mutex_destroy(&shared.output_mutex);
+    RunResult result = {duration<double>(end - start).count(), config.items, {}, allocations};
+    for (auto &arg : args)
+    {
+        result.latencies.insert(result.latencies.end(), arg.latencies.begin(), arg.latencies.end());
+    }
+    return result;
+}
+
+/* Данные пары производитель-потребитель, связанной кольцом SpscRing */
+struct SpscShared
+{
+    SpscRing<Product> *ring;
+    int items;
+    vector<double> latencies; // Задержки, замеренные потребителем
+};
+
+void *spsc_producer_func(void *arg)
+{
+    SpscShared *shared = static_cast<SpscShared *>(arg);
+    for (int number = 1; number <= shared->items; ++number)
+    {
+        shared->ring->push({number, production_stamp(number)});
+        if (verbose)
+            cout << "Produced product #" << number << endl;
+    }
+    shared->ring->close();
+    return NULL;
+}
+
+void *spsc_consumer_func(void *arg)
+{
+    SpscShared *shared = static_cast<SpscShared *>(arg);
+    Product product;
+    while (shared->ring->pop(product))
+    {
+        record_latency(product, steady_clock::now(), shared->latencies);
+        if (verbose)
+            cout << "Consumed product #" << product.number << endl
+                 << endl;
+    }
+    return NULL;
+}
+
+/* Запуск схемы с кольцом без блокировок: ровно один производитель и один потребитель */
+RunResult run_spsc(const Config &config)
+{
+    SpscRing<Product> ring(config.capacity, config.spin);
+    SpscShared shared = {&ring, config.items, {}};
+    shared.latencies.reserve(config.items / latency_sample + 1);
+    pthread_t producer, consumer;
+    int err;
+    long long allocations = heap_allocations.load();
+    auto start = steady_clock::now();
+    err = pthread_create(&producer, NULL, spsc_producer_func, &shared);
+    if (err != 0)
+    {
+        err_exit(err, "Cannot create the producer thread");
+    }
+    err = pthread_create(&consumer, NULL, spsc_consumer_func, &shared);
+    if (err != 0)
+    {
+        err_exit(err, "Cannot create the consumer thread");
+    }
+    if (config.pin)
+    {
+        pin_thread(producer, 0);
+        pin_thread(consumer, 1);
+    }
+    err = pthread_join(producer, NULL);
+    if (err != 0)
+    {
+        err_exit(err, "Cannot join the producer thread");
+    }
+    err = pthread_join(consumer, NULL);
+    if (err != 0)
+    {
+        err_exit(err, "Cannot join the consumer thread");
+    }
+    auto end = steady_clock::now();
+    allocations = heap_allocations.load() - allocations;
+    return {duration<double>(end - start).count(), config.items, shared.latencies, allocations};
+}
+
+/* Заголовок продукта в начале слота пула или буфера; за ним идет содержимое */
+struct PayloadHeader
+{
+    int number;
+    steady_clock::time_point produced_at;
+};
+
+/* Заполнение продукта на месте: заголовок и содержимое */
+void fill_payload(char *buffer, int payload, int number)
+{
+    PayloadHeader *header = reinterpret_cast<PayloadHeader *>(buffer);
+    header->number = number;
+    header->produced_at = production_stamp(number);
+    memset(buffer + sizeof(PayloadHeader), number & 0xff, payload - sizeof(PayloadHeader));
+}
+
+/* Потребление продукта: читаем по слову из каждой кэш-линии содержимого */
+unsigned long long consume_payload(const char *buffer, int payload, vector<double> &latencies)
+{
+    const PayloadHeader *header = reinterpret_cast<const PayloadHeader *>(buffer);
+    record_latency({header->number, header->produced_at}, steady_clock::now(), latencies);
+    unsigned long long checksum = header->number;
+    for (int offset = sizeof(PayloadHeader); offset < payload; offset += 64)
+    {
+        checksum += (unsigned char)buffer[offset];
+    }
+    return checksum;
+}
+
+/* Данные схем с продуктами-буферами */
+struct PayloadShared
+{
+    ObjectPool *pool;          // Пул слотов (схема pool)
+    SpscRing<int> *slots;      // Индексы заполненных слотов (схема pool)
+    SpscRing<char *> *buffers; // Указатели на буферы, выделенные под каждый продукт (схема alloc)
+    int items;
+    int payload;
+    unsigned long long checksum; // Сумма, не дающая компилятору выбросить чтение продуктов
+    vector<double> latencies;
+};
+
+/* Производитель пула: берет свободный слот, заполняет его на месте и передает индекс */
+void *pool_producer_func(void *arg)
+{
+    PayloadShared *shared = static_cast<PayloadShared *>(arg);
+    for (int number = 1; number <= shared->items; ++number)
+    {
+        int index = shared->pool->acquire();
+        fill_payload(shared->pool->data(index), shared->payload, number);
+        shared->slots->push(index);
+    }
+    shared->slots->close();
+    return NULL;
+}
+
+/* Потребитель пула: читает слот по индексу и возвращает его в список свободных */
+void *pool_consumer_func(void *arg)
+{
+    PayloadShared *shared = static_cast<PayloadShared *>(arg);
+    int index;
+    while (shared->slots->pop(index))
+    {
+        shared->checksum += consume_payload(shared->pool->data(index), shared->payload, shared->latencies);
+        shared->pool->release(index);
+    }
+    return NULL;
+}
+
+/* Производитель исходной схемы буферов: выделяет и заполняет буфер под каждый продукт */
+void *alloc_producer_func(void *arg)
+{
+    PayloadShared *shared = static_cast<PayloadShared *>(arg);
+    for (int number = 1; number <= shared->items; ++number)
+    {
+        char *buffer = new char[shared->payload];
+        fill_payload(buffer, shared->payload, number);
+        shared->buffers->push(buffer);
+    }
+    shared->buffers->close();
+    return NULL;
+}
+
+void *alloc_consumer_func(void *arg)
+{
+    PayloadShared *shared = static_cast<PayloadShared *>(arg);
+    char *buffer;
+    while (shared->buffers->pop(buffer))
+    {
+        shared->checksum += consume_payload(buffer, shared->payload, shared->latencies);
+        delete[] buffer;
+    }
+    return NULL;
+}
+
+/*
+Запуск передачи продуктов размером payload байт: через пул слотов (use_pool)
+либо с выделением и освобождением буфера под каждый продукт
+*/
+RunResult run_payload(const Config &config, int payload, bool use_pool)
+{
+    payload = max(payload, (int)sizeof(PayloadHeader));
+    // Слотов хватает на заполненное кольцо плюс по слоту в руках производителя и потребителя
+    ObjectPool pool(use_pool ? config.capacity + 2 : 0, payload);
+    SpscRing<int> slots(config.capacity, config.spin);
+    SpscRing<char *> buffers(config.capacity, config.spin);
+    PayloadShared shared = {&pool, &slots, &buffers, config.items, payload, 0, {}};
+    shared.latencies.reserve(config.items / latency_sample + 1);
+    pthread_t producer, consumer;
+    int err;
+    long long allocations = heap_allocations.load();
+    auto start = steady_clock::now();
+    err = pthread_create(&producer, NULL, use_pool ? pool_producer_func : alloc_producer_func, &shared);
+    if (err != 0)
+    {
+        err_exit(err, "Cannot create the producer thread");
+    }
+    err = pthread_create(&consumer, NULL, use_pool ? pool_consumer_func : alloc_consumer_func, &shared);
+    if (err != 0)
+    {
+        err_exit(err, "Cannot create the consumer thread");
+    }
+    if (config.pin)
+    {
+        pin_thread(producer, 0);
+        pin_thread(consumer, 1);
+    }
+    err = pthread_join(producer, NULL);
+    if (err != 0)
+    {
+        err_exit(err, "Cannot join the producer thread");
+    }
+    err = pthread_join(consumer, NULL);
+    if (err != 0)
+    {
+        err_exit(err, "Cannot join the consumer thread");
+    }
+    auto end = steady_clock::now();
+    allocations = heap_allocations.load() - allocations;
+    if (verbose)
+        cout << "Consumed " << config.items << " products of " << payload
+             << " bytes, checksum " << shared.checksum << endl;
+    return {duration<double>(end - start).count(), config.items, shared.latencies, allocations};
+}
+
+/* Значение перцентиля p (0..100) из отсортированного вектора */
+double percentile(const vector<double> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t index = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[min(index, sorted.size() - 1)];
+}
+
+void print_result(const char *mode, const Config &config, int producers, int consumers, int payload,
+                  RunResult &result)
+{
+    sort(result.latencies.begin(), result.latencies.end());
+    cout << mode << "," << producers << "," << consumers << "," << result.items << ","
+         << config.capacity << "," << config.batch << "," << payload << ","
+         << setprecision(3) << (double)result.allocations / result.items << ","
+         << setprecision(0) << result.items / result.seconds << ","
+         << setprecision(3) << percentile(result.latencies, 50) << "," << percentile(result.latencies, 99) << ","
+         << (result.latencies.empty() ? 0 : result.latencies.back()) << endl;
+}
+
+bool parse_args(int argc, char *argv[], Config &config)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--bench" || arg == "--pin")
+        {
+            (arg == "--bench" ? config.bench : config.pin) = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+            return false;
+        string value = argv[++i];
+        if (arg == "--mode")
+            config.mode = value;
+        else if (arg == "--producers")
+            config.producers = atoi(value.c_str());
+        else if (arg == "--consumers")
+            config.consumers = atoi(value.c_str());
+        else if (arg == "--items")
+            config.items = atoi(value.c_str());
+        else if (arg == "--legacy-items")
+            config.legacy_items = atoi(value.c_str());
+        else if (arg == "--capacity")
+            config.capacity = atoi(value.c_str());
+        else if (arg == "--batch")
+            config.batch = atoi(value.c_str());
+        else if (arg == "--spin")
+            config.spin = atoi(value.c_str());
+        else if (arg == "--payload")
+        {
+            config.payloads.clear();
+            stringstream stream(value);
+            string item;
+            while (getline(stream, item, ','))
+                config.payloads.push_back(atoi(item.c_str()));
+        }
+        else
+            return false;
+    }
+    return config.producers > 0 && config.consumers > 0 && config.items > 0 && config.capacity > 0;
+}
+
+int main(int argc, char *argv[])
+{
+    Config config;
+    if (!parse_args(argc, argv, config))
+    {
+        cerr << "Usage: " << argv[0] << " [--mode legacy|channel|spsc|pool|alloc|all] [--producers M] [--consumers N]\n"
+             << "       [--items K] [--legacy-items K] [--capacity C] [--batch B]\n"
+             << "       [--spin N] [--payload 64,4096,1048576] [--pin] [--bench]" << endl;
+        return EXIT_FAILURE;
+    }
+    verbose = !config.bench;
+    latency_sample = max(1, config.items / 1000000);
+    bool all = config.mode == "all";
+    if (config.bench)
+    {
+        cout << fixed;
+        cout << "mode,producers,consumers,items,capacity,batch,payload_bytes,allocs_per_item,items_per_s,p50_us,p99_us,max_us" << endl;
+    }
+    if (all || config.mode == "legacy")
+    {
+        RunResult result = run_legacy(config.bench ? config.legacy_items : config.items);
+        if (config.bench)
+            print_result("legacy", config, 1, 1, sizeof(Product), result);
+    }
+    if (all || config.mode == "channel")
+    {
+        RunResult result = run_channel(config);
+        if (config.bench)
+            print_result("channel", config, config.producers, config.consumers, sizeof(Product), result);
+    }
+    if (all || config.mode == "spsc")
+    {
+        RunResult result = run_spsc(config);
+        if (config.bench)
+            print_result("spsc", config, 1, 1, sizeof(Product), result);
+    }
+    for (int payload : config.payloads)
+    {
+        if (all || config.mode == "alloc")
+        {
+            RunResult result = run_payload(config, payload, false);
+            if (config.bench)
+                print_result("alloc", config, 1, 1, payload, result);
+        }
+        if (all || config.mode == "pool")
+        {
+            RunResult result = run_payload(config, payload, true);
+            if (config.bench)
+                print_result("pool", config, 1, 1, payload, result);
+        }
+    }
     return 0;
-}
\ No newline at end of file
+}
@@ -6,6 +6,25 @@
 #include <vector>
 #include <map>
 #include <string>
+#include <atomic>
+#include <limits>
+#include <cmath>
+#include <new>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <fstream>
+#include <sstream>
+#include <deque>
+#include <memory>
+#include <system_error>
+#include "fast_random.h"
+#include "parallel.h"
+#include "shm_queue.h"
+#include "perf_counters.h"
 #define err_exit(code, str)                            \
     {                                                  \
         cerr << str << ": " << strerror(code) << endl; \
@@ -18,28 +37,112 @@ const int DEFAULT_NUM_THREADS = 4;
 const int DEFAULT_NUM_DUPLICATES_STR = 2;                                                                                                                                                                  // Количество дубликатов строки по умолчанию
 const string LETTERS = "aeiouy";                                                                                                                                                                           // Набор символов для подсчета
 const string DEFAULT_LINE = "C++ pthread is a POSIX (Portable Operating System Interface) library used for creating and managing threads in C++ applications, allowing for concurrent execution of code."; // Строка для подсчета символов по умолчанию
-pthread_mutex_t mutex;
-struct MapThreadArgs
+const int DEFAULT_CHUNK_SIZE = 16;                                                                                                                                                                         // Минимальный размер порции для динамического распределения
+const int NUM_LETTERS = 6;                                                                                                                                                                                 // Размер набора LETTERS
+#ifdef __cpp_lib_hardware_interference_size
+const size_t CACHE_LINE_SIZE = hardware_destructive_interference_size; // Минимальное расстояние между данными разных потоков
+#else
+const size_t CACHE_LINE_SIZE = 64;
+#endif
+pthread_mutex_t reduce_mutex;
+
+/*
+Счетчики одного map-потока. Выравнивание по размеру кэш-линии гарантирует, что
+соседние потоки не пишут в одну линию и не "перебрасывают" ее друг другу
+*/
+struct alignas(CACHE_LINE_SIZE) ThreadCounts
 {
-    vector<string> *lines;               // указатель на вкетор строк для обработки
-    int begin;                           // Начальный индекс диапазона строк, который обрабатывает поток
-    int end;                             // Конечный индекс диапазона строк, который обрабатывает поток
-    vector<map<char, int>> *map_results; // Указатель на словарь, с результатами работы функции map
+    int counts[NUM_LETTERS]; // Количество вхождений каждого символа из LETTERS
 };
-struct ReduceThreadArgs
+
+/* Способ распределения строк между потоками */
+enum ScheduleKind
 {
-    vector<map<char, int>> *map_results; // Указатель на словарь, с результатми работы map
-    int begin;                           // Начальный индекс диапазона строк, который обрабатывает поток
-    int end;                             // Конечный индекс диапазона строк, который обрабатывает поток
-    map<char, int> *reduce_results;      // Указатель на словарь, с результатми работы функции reduce
+    SCHEDULE_STATIC,  // Равные сегменты, вычисляемые заранее
+    SCHEDULE_DYNAMIC, // Порции фиксированного размера из общего атомарного курсора
+    SCHEDULE_GUIDED,  // Порции, уменьшающиеся пропорционально оставшейся работе (как schedule(guided) в OpenMP)
+    SCHEDULE_STEALING // Рекурсивное деление пополам с кражей работы (parallel_reduce), без фазы reduce
 };
 
-/* Функция для подсчета количества вхождения набора символов для сегмента строк */
-void *map_func(void *arg)
+/* Раздатчик порций работы для динамического и guided распределения */
+struct ChunkDispenser
+{
+    atomic<int> next; // Индекс первого ещё не выданного элемента
+    int total;        // Общее количество элементов
+    int num_threads;  // Количество потоков, разбирающих работу
+    int min_chunk;    // Минимальный размер порции
+    ScheduleKind kind;
+};
+
+/* Параметры потоков выровнены, чтобы аргументы соседних потоков не делили кэш-линию */
+struct alignas(CACHE_LINE_SIZE) MapThreadArgs
+{
+    vector<string> *lines;     // указатель на вкетор строк для обработки
+    int begin;                 // Начальный индекс диапазона строк, который обрабатывает поток
+    int end;                   // Конечный индекс диапазона строк, который обрабатывает поток
+    int *counts;               // Слот потока с результатами работы функции map (NUM_LETTERS счетчиков)
+    ChunkDispenser *dispenser; // Раздатчик порций (nullptr при статическом распределении)
+};
+struct alignas(CACHE_LINE_SIZE) ReduceThreadArgs
+{
+    vector<int *> *map_results;     // Указатель на слоты map-потоков с результатами работы map
+    int begin;                      // Начальный индекс диапазона слотов, который обрабатывает поток
+    int end;                        // Конечный индекс диапазона слотов, который обрабатывает поток
+    map<char, int> *reduce_results; // Указатель на словарь, с результатми работы функции reduce
+    ChunkDispenser *dispenser;      // Раздатчик порций (nullptr при статическом распределении)
+};
+
+/* Инициализация раздатчика порций */
+void dispenser_init(ChunkDispenser *dispenser, ScheduleKind kind, int total, int num_threads, int min_chunk)
+{
+    dispenser->next.store(0, memory_order_relaxed);
+    dispenser->total = total;
+    dispenser->num_threads = num_threads;
+    dispenser->min_chunk = min_chunk > 0 ? min_chunk : 1;
+    dispenser->kind = kind;
+}
+
+/*
+Выдает очередную порцию [begin, end]. Возвращает false, если работа закончилась.
+При guided-распределении размер порции равен остатку работы, деленному на число
+потоков, но не меньше min_chunk, поэтому курсор сдвигается через compare_exchange
+*/
+bool next_chunk(ChunkDispenser *dispenser, int &begin, int &end)
+{
+    int current = dispenser->next.load(memory_order_relaxed);
+    while (current < dispenser->total)
+    {
+        int chunk = dispenser->min_chunk;
+        if (dispenser->kind == SCHEDULE_GUIDED)
+        {
+            chunk = max(chunk, (dispenser->total - current) / dispenser->num_threads);
+        }
+        else
+        {
+            // При динамическом распределении размер порции постоянный, достаточно fetch_add
+            current = dispenser->next.fetch_add(chunk, memory_order_relaxed);
+            if (current >= dispenser->total)
+                return false;
+            begin = current;
+            end = min(current + chunk, dispenser->total) - 1;
+            return true;
+        }
+        int next = min(current + chunk, dispenser->total);
+        if (dispenser->next.compare_exchange_weak(current, next, memory_order_relaxed))
+        {
+            begin = current;
+            end = next - 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Подсчет количества вхождений набора символов в строках диапазона [begin, end] */
+void map_range(MapThreadArgs *args, int begin, int end)
 {
-    MapThreadArgs *args = static_cast<MapThreadArgs *>(arg);
     // Обрабатываем каждую строку из диапазона [begin, end]
-    for (int i = args->begin; i <= args->end; i++)
+    for (int i = begin; i <= end; i++)
     {
         // Проходим по каждому символу в строке
         for (char letter : (*args->lines)[i])
@@ -47,92 +150,165 @@ void *map_func(void *arg)
             // Приводим символ к нижнему регистру
             char letter_lower = tolower(letter);
             // Если символ входит в набор символов для подсчета
-            if (LETTERS.find(letter_lower) != string::npos)
+            size_t letter_index = LETTERS.find(letter_lower);
+            if (letter_index != string::npos)
             {
-                // Увеличиваем счетчик для данного символа в текущем словаре
-                (*args->map_results)[i][letter_lower]++;
+                // Увеличиваем счетчик для данного символа в слоте потока
+                args->counts[letter_index]++;
             }
         }
     }
+}
+
+/* Функция для подсчета количества вхождения набора символов для сегмента строк */
+void *map_func(void *arg)
+{
+    MapThreadArgs *args = static_cast<MapThreadArgs *>(arg);
+    if (args->dispenser == nullptr)
+    {
+        map_range(args, args->begin, args->end);
+        return nullptr;
+    }
+    // Забираем порции из общего курсора, пока работа не закончится
+    int begin, end;
+    while (next_chunk(args->dispenser, begin, end))
+    {
+        map_range(args, begin, end);
+    }
     return nullptr;
 }
 
 /* Функция для суммированния результатов подсчета количесвта вхождений набора
 символов для сегментов строк */
-void *reduce_func(void *arg)
+void reduce_range(ReduceThreadArgs *args, int begin, int end)
 {
-    ReduceThreadArgs *args = static_cast<ReduceThreadArgs *>(arg);
     int err;
-    // Проходим по заданному диапазону результатов
-    for (int i = args->begin; i <= args->end; i++)
+    // Суммируем слоты диапазона в локальные счетчики потока
+    int sums[NUM_LETTERS] = {};
+    for (int i = begin; i <= end; i++)
     {
-        // Для каждой пары (символ, количество вхождений) из текущего словаря
-        for (const auto &pair : (*args->map_results)[i])
+        for (int k = 0; k < NUM_LETTERS; k++)
         {
-            // Захватываем мьютекс
-            err = pthread_mutex_lock(&mutex);
-            if (err != 0)
-            {
-                err_exit(err, "Cannot lock mutex");
-            }
-            // Добавляем значение из текущего словаря в общий результат
-            (*args->reduce_results)[pair.first] += pair.second;
-            // Освобождаем мьютекс
-            err = pthread_mutex_unlock(&mutex);
-            if (err != 0)
-            {
-                err_exit(err, "Cannot unlock mutex");
-            }
+            sums[k] += (*args->map_results)[i][k];
         }
     }
+    // Захватываем мьютекс один раз на диапазон
+    err = pthread_mutex_lock(&reduce_mutex);
+    if (err != 0)
+    {
+        err_exit(err, "Cannot lock mutex");
+    }
+    // Добавляем локальные суммы в общий результат
+    for (int k = 0; k < NUM_LETTERS; k++)
+    {
+        (*args->reduce_results)[LETTERS[k]] += sums[k];
+    }
+    // Освобождаем мьютекс
+    err = pthread_mutex_unlock(&reduce_mutex);
+    if (err != 0)
+    {
+        err_exit(err, "Cannot unlock mutex");
+    }
+}
+
+void *reduce_func(void *arg)
+{
+    ReduceThreadArgs *args = static_cast<ReduceThreadArgs *>(arg);
+    if (args->dispenser == nullptr)
+    {
+        reduce_range(args, args->begin, args->end);
+        return nullptr;
+    }
+    int begin, end;
+    while (next_chunk(args->dispenser, begin, end))
+    {
+        reduce_range(args, begin, end);
+    }
     return nullptr;
 }
+/* Счетчики символов одного куска строк для parallel_reduce */
+struct LetterCounts
+{
+    int counts[NUM_LETTERS];
+};
+
+/*
+MapReduce на рекурсивном делении: каждый кусок строк считает символы в локальные
+счетчики, а результаты соседних кусков складываются деревом по мере завершения,
+поэтому общих слотов и отдельной фазы reduce нет
+*/
+map<char, int> map_reduce_stealing(vector<string> &lines, ThreadPool &pool, int chunk_size)
+{
+    LetterCounts zero = {};
+    LetterCounts total = parallel_reduce(
+        pool, 0, (int)lines.size(), chunk_size, zero,
+        [&lines](int begin, int end) {
+            LetterCounts local = {};
+            MapThreadArgs args = {&lines, begin, end - 1, local.counts, nullptr};
+            map_range(&args, begin, end - 1);
+            return local;
+        },
+        [](LetterCounts a, const LetterCounts &b) {
+            for (int k = 0; k < NUM_LETTERS; k++)
+                a.counts[k] += b.counts[k];
+            return a;
+        });
+    map<char, int> reduce_results;
+    for (int k = 0; k < NUM_LETTERS; k++)
+        reduce_results[LETTERS[k]] = total.counts[k];
+    return reduce_results;
+}
+
 /*
 Функция реализующая модель MapReduce. Распределяет работу между
-несколькими потоками для функций map и reduce
+несколькими потоками для функций map и reduce. Потоки берутся из постоянной
+команды team: map- и reduce-поток i выполняется потоком команды i, и все они
+работают одновременно, иначе упакованные слоты не показали бы ложного разделения.
+Каждый map-поток копит результат в собственном слоте. При padded_slots == false
+слоты лежат вплотную друг к другу (для сравнения с эффектом ложного разделения)
 */
 map<char, int> map_reduce(
     vector<string> &lines,
     void *(*map_thread_func)(void *),
     void *(*reduce_thread_func)(void *),
-    int num_threads)
+    ThreadTeam &team,
+    ScheduleKind schedule = SCHEDULE_STATIC,
+    int chunk_size = DEFAULT_CHUNK_SIZE,
+    bool padded_slots = true)
 {
+    int num_threads = team.size();
     // Если количество потоков больше количества строк, ограничиваем число потоков числом строк
     int map_num_threads = num_threads > lines.size() ? lines.size() : num_threads;
-    // Инициализируем вектор для хранения промежуточных результатов: на одну строку по одному словарю
-    vector<map<char, int>>
-        map_results(lines.size());
-    vector<pthread_t> map_threads(map_num_threads);         // Вектор идентификаторов map-потоков
+    // Инициализируем слоты для хранения промежуточных результатов: по одному на map-поток
+    vector<ThreadCounts> padded_counts(padded_slots ? map_num_threads : 0);
+    vector<int> packed_counts(padded_slots ? 0 : map_num_threads * NUM_LETTERS);
+    vector<int *> map_results(map_num_threads);
+    for (int i = 0; i < map_num_threads; ++i)
+    {
+        map_results[i] = padded_slots ? padded_counts[i].counts : &packed_counts[i * NUM_LETTERS];
+        fill(map_results[i], map_results[i] + NUM_LETTERS, 0);
+    }
     vector<MapThreadArgs> map_thread_args(map_num_threads); // Вектор параметров для каждого map - потока
-    int err;
+    // Раздатчик порций для динамического распределения (общий для всех map-потоков)
+    ChunkDispenser map_dispenser;
+    dispenser_init(&map_dispenser, schedule, lines.size(), map_num_threads, chunk_size);
+    ChunkDispenser *map_dispenser_ptr = schedule == SCHEDULE_STATIC ? nullptr : &map_dispenser;
     // Распределяем строки между потоками
     int base_segment_size = lines.size() / map_num_threads;
     int remainder = lines.size() % map_num_threads;
-    // Создаем потоки, каждый из которых обрабатывает свой сегмент строк
     for (int i = 0; i < map_num_threads; ++i)
     {
         int begin = i * base_segment_size + min(i, remainder);
         int end = begin + base_segment_size - (i < remainder ? 0 : 1);
-        map_thread_args[i] = {&lines, begin, end, &map_results};
-        err = pthread_create(&map_threads[i], nullptr, map_thread_func, &map_thread_args[i]);
-        if (err != 0)
-        {
-            err_exit(err, "Cannot create the map thread");
-        }
-    }
-
-    // Ожидаем завершения работы всех map-потоков
-    for (auto &thread : map_threads)
-    {
-        err = pthread_join(thread, nullptr);
-        if (err != 0)
-        {
-            err_exit(err, "Cannot join a map thread");
-        }
+        map_thread_args[i] = {&lines, begin, end, map_results[i], map_dispenser_ptr};
     }
+    // Запускаем map-потоки команды, каждый обрабатывает свой сегмент строк, и ждем их завершения
+    team.run([&](int i) {
+        if (i < map_num_threads)
+            map_thread_func(&map_thread_args[i]);
+    });
     // Если число потоков больше, чем элементов map_results, ограничиваем число потоков числом элементов map_results
     int reduce_num_threads = num_threads > map_results.size() ? map_results.size() : num_threads;
-    vector<pthread_t> reduce_threads(reduce_num_threads);            // Вектор идентификаторов reduce - потоков
     vector<ReduceThreadArgs> reduce_thread_args(reduce_num_threads); // Вектор параметров для каждого reduce - потока
     // Инициализация словар для хранения итогового результата
     map<char, int> reduce_results;
@@ -141,6 +317,9 @@ map<char, int> map_reduce(
     {
         reduce_results[letter] = 0;
     }
+    ChunkDispenser reduce_dispenser;
+    dispenser_init(&reduce_dispenser, schedule, map_results.size(), reduce_num_threads, chunk_size);
+    ChunkDispenser *reduce_dispenser_ptr = schedule == SCHEDULE_STATIC ? nullptr : &reduce_dispenser;
     // Распределяем строки между потоками
     base_segment_size = map_results.size() / reduce_num_threads;
     remainder = map_results.size() % reduce_num_threads;
@@ -148,25 +327,615 @@ map<char, int> map_reduce(
     {
         int begin = i * base_segment_size + min(i, remainder);
         int end = begin + base_segment_size - (i < remainder ? 0 : 1);
-        reduce_thread_args[i] = {&map_results, begin, end, &reduce_results};
-        err = pthread_create(&reduce_threads[i], nullptr, reduce_thread_func,
-                             &reduce_thread_args[i]);
-        if (err != 0)
+        reduce_thread_args[i] = {&map_results, begin, end, &reduce_results, reduce_dispenser_ptr};
+    }
+    // Запускаем reduce-потоки команды и ждем их завершения
+    team.run([&](int i) {
+        if (i < reduce_num_threads)
+            reduce_thread_func(&reduce_thread_args[i]);
+    });
+    return reduce_results;
+}
+/*
+Генерация строк с распределением длин с тяжелым хвостом (Парето): большая часть
+строк короткие, но редкие строки длиннее в сотни раз. Генератор с фиксированным
+зерном, чтобы замеры разных способов распределения шли на одинаковых данных
+*/
+vector<string> make_heavy_tailed_lines(int count)
+{
+    Xoshiro256 generator(42);
+    const double alpha = 1.1;     // Параметр формы распределения Парето
+    const int max_repeats = 1000; // Ограничение длины самой длинной строки
+    vector<string> lines(count);
+    for (auto &line : lines)
+    {
+        double u = generator.next_double();
+        int repeats = min(max_repeats, (int)(1.0 / pow(1.0 - u, 1.0 / alpha)));
+        line.reserve(repeats * DEFAULT_LINE.size());
+        for (int r = 0; r < repeats; r++)
         {
-            err_exit(err, "Cannot create the reduce thread");
+            line += DEFAULT_LINE;
         }
     }
-    // Ожидаем завершения работы всех reduce-потоков
-    for (auto &thread : reduce_threads)
+    return lines;
+}
+
+/* Разбор названия способа распределения, -1 для "all" */
+int parse_schedule(const string &name)
+{
+    if (name == "static")
+        return SCHEDULE_STATIC;
+    if (name == "dynamic")
+        return SCHEDULE_DYNAMIC;
+    if (name == "guided")
+        return SCHEDULE_GUIDED;
+    if (name == "stealing")
+        return SCHEDULE_STEALING;
+    return -1;
+}
+
+const char *schedule_name(ScheduleKind schedule)
+{
+    switch (schedule)
     {
-        err = pthread_join(thread, nullptr);
-        if (err != 0)
+    case SCHEDULE_DYNAMIC:
+        return "dynamic";
+    case SCHEDULE_GUIDED:
+        return "guided";
+    case SCHEDULE_STEALING:
+        return "stealing";
+    default:
+        return "static";
+    }
+}
+
+const int THREAD_RUNS = 100; // Замеров на способ распределения и раскладку слотов
+
+/* Итог серии замеров: время и медианы счетчиков за один замер */
+struct MapReduceStats
+{
+    double min_time;
+    SampleStats time;                   // Медиана, MAD и 99-й перцентиль времени замера
+    PerfSample counters;                // Медианы по замерам суммы по всем потокам
+    vector<pid_t> thread_ids;           // Потоки команды, а при краже работы - пула ([0] - главный поток)
+    vector<PerfSample> thread_counters; // Медианы по замерам для каждого потока
+};
+
+/*
+Серия из THREAD_RUNS замеров для заданного способа распределения и раскладки слотов.
+Счетчики навешиваются на все потоки команды (или пула) и снимаются в каждом замере отдельно,
+поэтому выбросы (вытеснение, миграция) видны в MAD и p99, а не размазаны по сумме.
+HITM-события (чтения модифицированных линий соседнего ядра) общим perf_event не
+выражаются, для них используется perf c2c
+*/
+MapReduceStats measure_map_reduce(vector<string> &lines, int num_threads, ScheduleKind schedule, int chunk_size,
+                                  bool padded_slots, map<char, int> &best_result)
+{
+    // Кража работы идет на пуле, остальные способы - на выделенных потоках команды
+    unique_ptr<ThreadPool> pool;
+    unique_ptr<ThreadTeam> team;
+    if (schedule == SCHEDULE_STEALING)
+        pool.reset(new ThreadPool(num_threads));
+    else
+        team.reset(new ThreadTeam(num_threads));
+    MapReduceStats stats;
+    stats.min_time = numeric_limits<double>::max();
+    stats.thread_ids = pool ? pool->thread_ids() : team->thread_ids();
+    PerfCounters counters(stats.thread_ids);
+    vector<double> times;
+    vector<PerfSample> totals;
+    vector<vector<PerfSample>> per_thread(stats.thread_ids.size());
+    for (int i = 0; i < THREAD_RUNS; ++i)
+    {
+        counters.start();
+        auto start = high_resolution_clock::now();
+        auto result = pool ? map_reduce_stealing(lines, *pool, chunk_size)
+                           : map_reduce(lines, map_func, reduce_func, *team, schedule, chunk_size, padded_slots);
+        auto end = high_resolution_clock::now();
+        totals.push_back(counters.stop());
+        for (size_t t = 0; t < per_thread.size(); ++t)
+            per_thread[t].push_back(counters.per_thread()[t]);
+        double current_time = duration<double>(end - start).count();
+        times.push_back(current_time);
+        if (current_time < stats.min_time)
+        {
+            stats.min_time = current_time;
+            best_result = result;
+        }
+    }
+    stats.time = summarize(times);
+    for (int event = 0; event < PERF_EVENT_COUNT; ++event)
+        stats.counters.values[event] = median_event(totals, (PerfEvent)event);
+    for (const auto &samples : per_thread)
+    {
+        PerfSample medians;
+        for (int event = 0; event < PERF_EVENT_COUNT; ++event)
+            medians.values[event] = median_event(samples, (PerfEvent)event);
+        stats.thread_counters.push_back(medians);
+    }
+    return stats;
+}
+
+/* Состояние порции строк в многопроцессных бэкендах */
+enum ChunkState
+{
+    CHUNK_PENDING, // Ждет в очереди
+    CHUNK_CLAIMED, // Взята mapper-процессом
+    CHUNK_DONE,    // Результат записан
+    CHUNK_FAILED   // Роняла mapper-процессы MAX_CHUNK_ATTEMPTS раз, пропущена
+};
+
+const int MAX_CHUNK_ATTEMPTS = 3; // Сколько раз порция выдается, прежде чем считаться ядовитой
+const int BACKEND_RUNS = 20;      // Замеров на бэкенд: каждый замер заново порождает процессы
+
+/* Результат порции в разделяемой памяти: пишет mapper-процесс, читает родитель */
+struct alignas(CACHE_LINE_SIZE) ChunkSlot
+{
+    atomic<int> state;       // ChunkState
+    atomic<int> owner;       // pid процесса, взявшего порцию
+    int attempts;            // Сколько раз порция выдавалась (меняет только родитель)
+    int counts[NUM_LETTERS]; // Количество вхождений каждого символа из LETTERS
+};
+
+/* Статистика восстановления после падений mapper-процессов */
+struct BackendStats
+{
+    int crashed_workers = 0; // Процессов, завершившихся аварийно
+    int requeued_chunks = 0; // Порций, выданных повторно
+    int failed_chunks = 0;   // Порций, пропущенных после MAX_CHUNK_ATTEMPTS попыток
+};
+
+/* Подсчет символов в строках порции chunk */
+void count_chunk(vector<string> &lines, int chunk, int chunk_size, int *counts)
+{
+    int begin = chunk * chunk_size;
+    int end = min((int)lines.size(), begin + chunk_size) - 1;
+    fill(counts, counts + NUM_LETTERS, 0);
+    MapThreadArgs args = {&lines, begin, end, counts, nullptr};
+    map_range(&args, begin, end);
+}
+
+/* Списки CPU по узлам NUMA из sysfs. Один узел или недоступный sysfs - пустой список */
+vector<vector<int>> numa_node_cpus()
+{
+    vector<vector<int>> nodes;
+    for (int node = 0;; ++node)
+    {
+        ifstream file("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+        string list;
+        if (!(file >> list))
+            break;
+        // Формат: "0-3,8,10-11"
+        vector<int> cpus;
+        stringstream ranges(list);
+        string range;
+        while (getline(ranges, range, ','))
+        {
+            int first, last;
+            if (sscanf(range.c_str(), "%d-%d", &first, &last) == 1)
+                last = first;
+            for (int cpu = first; cpu <= last; ++cpu)
+                cpus.push_back(cpu);
+        }
+        nodes.push_back(cpus);
+    }
+    if (nodes.size() < 2)
+        nodes.clear();
+    return nodes;
+}
+
+/*
+Привязка процесса к процессорам узла NUMA по его номеру - только привязка CPU,
+размещение памяти она не меняет. Строки процесс наследует от родителя через fork
+(копирование при записи), поэтому они остаются на узле родителя, а count_chunk
+памяти не выделяет. Копировать строки на свой узел нет смысла: каждая порция
+читается за замер один раз, и копия стоила бы столько же удаленных чтений
+*/
+void pin_to_numa_node(int worker, const vector<vector<int>> &nodes)
+{
+    if (nodes.empty())
+        return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : nodes[worker % nodes.size()])
+        CPU_SET(cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+}
+
+/*
+Тело mapper-процесса: забирает порции из общей очереди, пока она не опустеет.
+crash_after > 0 имитирует падение: процесс убивает себя, взяв порцию номер crash_after
+*/
+void process_worker(vector<string> &lines, ShmQueue *queue, ChunkSlot *slots, int chunk_size, int crash_after)
+{
+    int32_t chunk;
+    int processed = 0;
+    while (queue->try_pop(chunk))
+    {
+        ChunkSlot &slot = slots[chunk];
+        slot.owner.store(getpid(), memory_order_relaxed);
+        slot.state.store(CHUNK_CLAIMED, memory_order_release);
+        if (crash_after > 0 && processed == crash_after)
+            raise(SIGKILL);
+        int counts[NUM_LETTERS];
+        count_chunk(lines, chunk, chunk_size, counts);
+        memcpy(slot.counts, counts, sizeof(counts));
+        slot.state.store(CHUNK_DONE, memory_order_release);
+        processed++;
+    }
+}
+
+pid_t spawn_process_worker(int worker, const vector<vector<int>> &nodes, vector<string> &lines, ShmQueue *queue,
+                           ChunkSlot *slots, int chunk_size, int crash_after)
+{
+    pid_t pid = fork();
+    if (pid < 0)
+        err_exit(errno, "Cannot fork a mapper process");
+    if (pid == 0)
+    {
+        pin_to_numa_node(worker, nodes);
+        process_worker(lines, queue, slots, chunk_size, crash_after);
+        _exit(0);
+    }
+    return pid;
+}
+
+/*
+Возвращает в очередь незавершенные порции процесса owner (0 - любые незавершенные).
+Порция, исчерпавшая попытки, помечается как пропущенная. Возвращает число
+повторно выданных порций
+*/
+int requeue_chunks(ShmQueue *queue, ChunkSlot *slots, int chunks, pid_t owner, BackendStats &stats)
+{
+    int requeued = 0;
+    for (int chunk = 0; chunk < chunks; ++chunk)
+    {
+        ChunkSlot &slot = slots[chunk];
+        int state = slot.state.load(memory_order_acquire);
+        if (state == CHUNK_DONE || state == CHUNK_FAILED)
+            continue;
+        if (owner != 0 && (state != CHUNK_CLAIMED || slot.owner.load(memory_order_relaxed) != owner))
+            continue;
+        if (slot.attempts >= MAX_CHUNK_ATTEMPTS)
+        {
+            slot.state.store(CHUNK_FAILED, memory_order_relaxed);
+            stats.failed_chunks++;
+            continue;
+        }
+        slot.attempts++;
+        slot.owner.store(0, memory_order_relaxed);
+        slot.state.store(CHUNK_PENDING, memory_order_relaxed);
+        queue->try_push(chunk);
+        requeued++;
+    }
+    stats.requeued_chunks += requeued;
+    return requeued;
+}
+
+/*
+MapReduce на процессах: порции строк раздаются через очередь без блокировок в
+разделяемой памяти (shm_open + mmap), результаты порций пишутся в слоты там же,
+reduce - сумма слотов в родителе. Строки mapper-процессы получают через fork.
+Упавший mapper (любой выход, кроме exit(0)) заменяется новым, а взятые им порции
+возвращаются в очередь; после завершения всех процессов порции, потерянные между
+извлечением из очереди и пометкой, выдаются повторно
+*/
+map<char, int> map_reduce_processes(vector<string> &lines, int num_processes, int chunk_size, int crash_after,
+                                    BackendStats &stats)
+{
+    chunk_size = max(1, chunk_size);
+    int chunks = (lines.size() + chunk_size - 1) / chunk_size;
+    // Через очередь пройдет не больше chunks * MAX_CHUNK_ATTEMPTS значений, и она никогда не обойдет кольцо
+    size_t queue_capacity = max(1, chunks * MAX_CHUNK_ATTEMPTS);
+    size_t queue_bytes = (ShmQueue::bytes_for(queue_capacity) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    size_t bytes = queue_bytes + chunks * sizeof(ChunkSlot);
+    void *memory;
+    try
+    {
+        memory = shm_map(bytes);
+    }
+    catch (const system_error &error)
+    {
+        err_exit(error.code().value(), "Cannot map shared memory");
+    }
+    ShmQueue *queue = ShmQueue::create(memory, queue_capacity);
+    ChunkSlot *slots = reinterpret_cast<ChunkSlot *>(static_cast<char *>(memory) + queue_bytes);
+    for (int chunk = 0; chunk < chunks; ++chunk)
+    {
+        ChunkSlot *slot = new (&slots[chunk]) ChunkSlot;
+        slot->state.store(CHUNK_PENDING, memory_order_relaxed);
+        slot->owner.store(0, memory_order_relaxed);
+        slot->attempts = 1;
+        queue->try_push(chunk);
+    }
+    vector<vector<int>> nodes = numa_node_cpus();
+    int live = 0;
+    for (int worker = 0; worker < num_processes; ++worker, ++live)
+        spawn_process_worker(worker, nodes, lines, queue, slots, chunk_size, worker == 0 ? crash_after : 0);
+    int spawned = num_processes;
+    while (live > 0)
+    {
+        while (live > 0)
+        {
+            int status;
+            pid_t pid = waitpid(-1, &status, 0);
+            if (pid < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                err_exit(errno, "Cannot wait for a mapper process");
+            }
+            live--;
+            if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+                continue;
+            // Аварийное завершение: возвращаем его порции и запускаем замену
+            stats.crashed_workers++;
+            requeue_chunks(queue, slots, chunks, pid, stats);
+            spawn_process_worker(spawned++, nodes, lines, queue, slots, chunk_size, 0);
+            live++;
+        }
+        // Все процессы вышли, очередь пуста: добираем порции, потерянные до пометки CLAIMED
+        if (requeue_chunks(queue, slots, chunks, 0, stats) > 0)
         {
-            err_exit(err, "Cannot join a map thread");
+            spawn_process_worker(spawned++, nodes, lines, queue, slots, chunk_size, 0);
+            live++;
         }
     }
+    map<char, int> reduce_results;
+    for (char letter : LETTERS)
+        reduce_results[letter] = 0;
+    for (int chunk = 0; chunk < chunks; ++chunk)
+    {
+        if (slots[chunk].state.load(memory_order_acquire) != CHUNK_DONE)
+            continue;
+        for (int k = 0; k < NUM_LETTERS; k++)
+            reduce_results[LETTERS[k]] += slots[chunk].counts[k];
+    }
+    shm_unmap(memory, bytes);
     return reduce_results;
 }
+
+/* Сообщения между координатором и узлом: номер порции (-1 - завершиться) и ответ с результатом */
+struct ChunkRequest
+{
+    int32_t chunk;
+};
+
+struct ChunkReply
+{
+    int32_t chunk;
+    int32_t counts[NUM_LETTERS];
+};
+
+bool read_full(int fd, void *buffer, size_t size)
+{
+    char *data = static_cast<char *>(buffer);
+    while (size > 0)
+    {
+        ssize_t received = read(fd, data, size);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return false;
+        data += received;
+        size -= received;
+    }
+    return true;
+}
+
+/* Запись без SIGPIPE: отправка упавшему узлу просто возвращает false */
+bool write_full(int fd, const void *buffer, size_t size)
+{
+    const char *data = static_cast<const char *>(buffer);
+    while (size > 0)
+    {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+/* Узел-процесс: обрабатывает присланные порции, пока координатор не пришлет -1 */
+void node_loop(int fd, vector<string> &lines, int chunk_size, int crash_after)
+{
+    ChunkRequest request;
+    int processed = 0;
+    while (read_full(fd, &request, sizeof(request)) && request.chunk >= 0)
+    {
+        if (crash_after > 0 && processed == crash_after)
+            raise(SIGKILL);
+        ChunkReply reply;
+        reply.chunk = request.chunk;
+        count_chunk(lines, request.chunk, chunk_size, reply.counts);
+        if (!write_full(fd, &reply, sizeof(reply)))
+            break;
+        processed++;
+    }
+}
+
+/* Узел со стороны координатора */
+struct NodeHandle
+{
+    pid_t pid;
+    int fd;          // Сокет координатора, -1 после остановки узла
+    int outstanding; // Порция, отданная узлу, или -1
+};
+
+NodeHandle spawn_node(int node, const vector<vector<int>> &numa_nodes, const vector<NodeHandle> &others,
+                      vector<string> &lines, int chunk_size, int crash_after)
+{
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0)
+        err_exit(errno, "Cannot create a socket pair");
+    pid_t pid = fork();
+    if (pid < 0)
+        err_exit(errno, "Cannot fork a node process");
+    if (pid == 0)
+    {
+        close(sockets[0]);
+        for (const NodeHandle &other : others)
+        {
+            if (other.fd >= 0)
+                close(other.fd);
+        }
+        pin_to_numa_node(node, numa_nodes);
+        node_loop(sockets[1], lines, chunk_size, crash_after);
+        _exit(0);
+    }
+    close(sockets[1]);
+    return {pid, sockets[0], -1};
+}
+
+/*
+MapReduce на узлах, связанных сокетами Unix: вместо общей памяти координатор
+раздает номера порций по сокету по одной на узел и получает в ответ счетчики.
+Узлы - локальные процессы, получающие строки через fork (модель узлов, на которых
+данные уже лежат). Оборванное соединение означает падение узла: его порция
+отдается другим, а вместо него запускается новый узел
+*/
+map<char, int> map_reduce_sockets(vector<string> &lines, int num_nodes, int chunk_size, int crash_after,
+                                  BackendStats &stats)
+{
+    chunk_size = max(1, chunk_size);
+    int chunks = (lines.size() + chunk_size - 1) / chunk_size;
+    deque<int> pending;
+    for (int chunk = 0; chunk < chunks; ++chunk)
+        pending.push_back(chunk);
+    vector<int> attempts(chunks, 1);
+    vector<vector<int>> numa_nodes = numa_node_cpus();
+    vector<NodeHandle> nodes;
+    for (int node = 0; node < num_nodes; ++node)
+        nodes.push_back(spawn_node(node, numa_nodes, nodes, lines, chunk_size, node == 0 ? crash_after : 0));
+    int finished = 0; // Выполненные и пропущенные порции
+    map<char, int> reduce_results;
+    for (char letter : LETTERS)
+        reduce_results[letter] = 0;
+    // Отдает узлу следующую порцию, а если порций нет - останавливает его
+    auto dispatch = [&](NodeHandle &node) {
+        if (pending.empty())
+        {
+            ChunkRequest stop = {-1};
+            write_full(node.fd, &stop, sizeof(stop));
+            close(node.fd);
+            node.fd = -1;
+            return;
+        }
+        node.outstanding = pending.front();
+        pending.pop_front();
+        ChunkRequest request = {node.outstanding};
+        // Ошибку записи обнаружит poll как разрыв соединения
+        write_full(node.fd, &request, sizeof(request));
+    };
+    for (NodeHandle &node : nodes)
+        dispatch(node);
+    while (finished < chunks)
+    {
+        vector<pollfd> fds;
+        vector<size_t> owners;
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            if (nodes[i].fd >= 0)
+            {
+                fds.push_back({nodes[i].fd, POLLIN, 0});
+                owners.push_back(i);
+            }
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            err_exit(errno, "Cannot poll node sockets");
+        }
+        for (size_t k = 0; k < fds.size(); ++k)
+        {
+            if (fds[k].revents == 0)
+                continue;
+            NodeHandle &node = nodes[owners[k]];
+            ChunkReply reply;
+            if (read_full(node.fd, &reply, sizeof(reply)))
+            {
+                for (int i = 0; i < NUM_LETTERS; i++)
+                    reduce_results[LETTERS[i]] += reply.counts[i];
+                node.outstanding = -1;
+                finished++;
+                dispatch(node);
+                continue;
+            }
+            // Соединение оборвалось: узел упал вместе с отданной ему порцией
+            stats.crashed_workers++;
+            close(node.fd);
+            node.fd = -1;
+            waitpid(node.pid, nullptr, 0);
+            int lost = node.outstanding;
+            node.outstanding = -1;
+            if (lost >= 0 && attempts[lost] >= MAX_CHUNK_ATTEMPTS)
+            {
+                stats.failed_chunks++;
+                finished++;
+            }
+            else if (lost >= 0)
+            {
+                attempts[lost]++;
+                stats.requeued_chunks++;
+                pending.push_front(lost);
+            }
+            if (!pending.empty())
+            {
+                // Вектор узлов может переехать, поэтому ссылка node дальше не используется
+                NodeHandle replacement = spawn_node(nodes.size(), numa_nodes, nodes, lines, chunk_size, 0);
+                nodes.push_back(replacement);
+                dispatch(nodes.back());
+            }
+            break; // Список дескрипторов устарел, заново собираем его для poll
+        }
+    }
+    for (NodeHandle &node : nodes)
+    {
+        if (node.fd >= 0)
+        {
+            ChunkRequest stop = {-1};
+            write_full(node.fd, &stop, sizeof(stop));
+            close(node.fd);
+        }
+        waitpid(node.pid, nullptr, 0);
+    }
+    return reduce_results;
+}
+
+/* Лучшее время из BACKEND_RUNS замеров многопроцессного бэкенда */
+double measure_backend(map<char, int> (*backend)(vector<string> &, int, int, int, BackendStats &),
+                       vector<string> &lines, int num_processes, int chunk_size, int crash_after,
+                       map<char, int> &best_result, BackendStats &stats)
+{
+    double min_time = numeric_limits<double>::max();
+    for (int i = 0; i < BACKEND_RUNS; ++i)
+    {
+        BackendStats run_stats;
+        auto start = high_resolution_clock::now();
+        auto result = backend(lines, num_processes, chunk_size, crash_after, run_stats);
+        auto end = high_resolution_clock::now();
+        double current_time = duration<double>(end - start).count();
+        if (current_time < min_time)
+        {
+            min_time = current_time;
+            best_result = result;
+        }
+        stats = run_stats;
+    }
+    return min_time;
+}
+
+/* Вывод значения счетчика, либо n/a, если счетчик недоступен */
+string format_counter(long long value)
+{
+    return value < 0 ? "n/a" : to_string(value);
+}
+
 int main()
 {
     char repeat;
@@ -174,41 +943,115 @@ int main()
     do
     {
         // Ввод параметров
-        int num_threads, num_duplicates;
+        int num_threads, num_duplicates, chunk_size;
+        char heavy_tailed;
+        string schedule_input, layout_input, backend_input;
+        int crash_after = 0;
         cout << "Enter number of threads: ";
         cin >> num_threads;
         cout << "Enter number of duplicates: ";
         cin >> num_duplicates;
+        cout << "Heavy-tailed line lengths? (y/n): ";
+        cin >> heavy_tailed;
+        cout << "Enter schedule (static/dynamic/guided/stealing/all): ";
+        cin >> schedule_input;
+        cout << "Enter minimal chunk size: ";
+        cin >> chunk_size;
+        cout << "Enter slots layout (padded/packed/both): ";
+        cin >> layout_input;
+        cout << "Enter backend (threads/processes/sockets/all): ";
+        cin >> backend_input;
+        bool run_threads = backend_input == "threads" || backend_input == "all";
+        bool run_processes = backend_input == "processes" || backend_input == "all";
+        bool run_sockets = backend_input == "sockets" || backend_input == "all";
+        if (!run_processes && !run_sockets)
+            run_threads = true;
+        if (run_processes || run_sockets)
+        {
+            cout << "Kill the first mapper after N chunks (0 - no crash): ";
+            cin >> crash_after;
+        }
         // Инициализация данных
-        vector<string> lines(num_duplicates, DEFAULT_LINE);
+        vector<string> lines = heavy_tailed == 'y' || heavy_tailed == 'Y'
+                                   ? make_heavy_tailed_lines(num_duplicates)
+                                   : vector<string>(num_duplicates, DEFAULT_LINE);
+        double megabytes = 0;
+        for (const auto &line : lines)
+            megabytes += line.size() / 1e6;
+        // Список способов распределения для замера
+        vector<ScheduleKind> schedules;
+        int parsed_schedule = parse_schedule(schedule_input);
+        if (parsed_schedule < 0)
+            schedules = {SCHEDULE_STATIC, SCHEDULE_DYNAMIC, SCHEDULE_GUIDED, SCHEDULE_STEALING};
+        else
+            schedules = {static_cast<ScheduleKind>(parsed_schedule)};
         // Инициализация мьютекса
-        err = pthread_mutex_init(&mutex, nullptr);
+        err = pthread_mutex_init(&reduce_mutex, nullptr);
         if (err != 0)
             err_exit(err, "Cannot initialize mutex");
-        // Цикл замеров времени
-        double min_time = numeric_limits<double>::max();
+        // Список раскладок слотов для замера
+        vector<bool> layouts;
+        if (layout_input == "packed")
+            layouts = {false};
+        else if (layout_input == "both")
+            layouts = {false, true};
+        else
+            layouts = {true};
+        // Цикл замеров времени для каждого способа распределения и раскладки
         map<char, int> best_result;
-        for (int i = 0; i < 100; ++i)
+        for (ScheduleKind schedule : run_threads ? schedules : vector<ScheduleKind>())
         {
-            auto start = high_resolution_clock::now();
-            auto result = map_reduce(lines, map_func, reduce_func, num_threads);
-            auto end = high_resolution_clock::now();
-            double current_time = duration<double>(end - start).count();
-            if (current_time < min_time)
+            for (bool padded_slots : layouts)
             {
-                min_time = current_time;
-                best_result = result;
+                // При краже работы счетчики локальные, раскладка слотов не влияет: замеряем один раз
+                if (schedule == SCHEDULE_STEALING && padded_slots != layouts.back())
+                    continue;
+                MapReduceStats stats = measure_map_reduce(lines, num_threads, schedule, chunk_size, padded_slots,
+                                                          best_result);
+                const char *layout = schedule == SCHEDULE_STEALING ? "local" : padded_slots ? "padded" : "packed";
+                cout << "\nSchedule " << schedule_name(schedule) << ", " << layout
+                     << " slots: best execution time: " << stats.min_time << "s ("
+                     << megabytes / stats.min_time << " MB/s)\n";
+                cout << "Time over " << THREAD_RUNS << " runs: median " << stats.time.median << "s, MAD "
+                     << stats.time.mad << "s, p99 " << stats.time.p99 << "s\n";
+                cout << "Median counters per run:";
+                for (int event = 0; event < PERF_EVENT_COUNT; ++event)
+                    cout << (event ? ", " : " ") << PerfCounters::name((PerfEvent)event) << " "
+                         << format_counter(stats.counters.values[event]);
+                cout << "\n";
+                for (size_t t = 0; t < stats.thread_ids.size(); ++t)
+                {
+                    const PerfSample &sample = stats.thread_counters[t];
+                    cout << "  thread " << stats.thread_ids[t] << ": cycles "
+                         << format_counter(sample.values[PERF_CYCLES]) << ", instructions "
+                         << format_counter(sample.values[PERF_INSTRUCTIONS]) << ", llc_misses "
+                         << format_counter(sample.values[PERF_LLC_MISSES]) << ", context_switches "
+                         << format_counter(sample.values[PERF_CONTEXT_SWITCHES]) << ", migrations "
+                         << format_counter(sample.values[PERF_MIGRATIONS]) << "\n";
+                }
             }
         }
+        // Многопроцессные бэкенды: порции по chunk_size строк, по процессу на поток
+        for (bool sockets : {false, true})
+        {
+            if (!(sockets ? run_sockets : run_processes))
+                continue;
+            BackendStats stats;
+            double min_time = measure_backend(sockets ? map_reduce_sockets : map_reduce_processes, lines, num_threads,
+                                              chunk_size, crash_after, best_result, stats);
+            cout << "\nBackend " << (sockets ? "sockets" : "processes") << ": best execution time: " << min_time
+                 << "s (" << megabytes / min_time << " MB/s)\n";
+            cout << "Crashed mappers: " << stats.crashed_workers << ", requeued chunks: " << stats.requeued_chunks
+                 << ", failed chunks: " << stats.failed_chunks << "\n";
+        }
         // Вывод результатов
-        cout << "\nBest execution time: " << min_time << "s\n";
         cout << "Letter counts:\n";
         for (const auto &pair : best_result)
         {
             cout << pair.first << ": " << pair.second << endl;
         }
         // Очистка ресурсов
-        pthread_mutex_destroy(&mutex);
+        pthread_mutex_destroy(&reduce_mutex);
         // Запрос на повторение
         cout << "\nRepeat test? (y/n): ";
         cin >> repeat;
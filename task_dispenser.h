@@ -0,0 +1,103 @@
+#ifndef TASK_DISPENSER_H
+#define TASK_DISPENSER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+/*
+Раздатчик номеров заданий без блокировок. Поток забирает сразу порцию из K
+заданий одним fetch_add по общему курсору, поэтому курсор трогается не чаще раза
+на порцию, и число потоков не ограничено.
+K подбирает каждый поток сам (TaskClaimer): по времени выполнения предыдущей порции
+он оценивает стоимость одного задания и берет столько, чтобы порция занимала
+около target_batch. К концу работы порции ограничиваются долей остатка, чтобы
+последние задания не достались одному потоку
+*/
+class TaskDispenser
+{
+public:
+    TaskDispenser(int total, int threads,
+                  std::chrono::nanoseconds target_batch = std::chrono::microseconds(50),
+                  int max_batch = 4096)
+        : total(total), threads(threads > 0 ? threads : 1), target_batch(target_batch), max_batch(max_batch)
+    {
+    }
+
+    /* Забирает до count заданий. Возвращает false, если задания закончились */
+    bool claim(int count, int &begin, int &end)
+    {
+        // Чтение перед fetch_add не дает курсору бесконечно расти после окончания заданий
+        if (next.load(std::memory_order_relaxed) >= total)
+            return false;
+        begin = next.fetch_add(count, std::memory_order_relaxed);
+        if (begin >= total)
+            return false;
+        end = std::min(begin + count, total);
+        return true;
+    }
+
+    /* Сколько заданий еще не выдано (приблизительно) */
+    int remaining() const
+    {
+        return std::max(0, total - next.load(std::memory_order_relaxed));
+    }
+
+    int total_tasks() const { return total; }
+    int thread_count() const { return threads; }
+    std::chrono::nanoseconds target() const { return target_batch; }
+    int batch_limit() const { return max_batch; }
+
+private:
+    alignas(64) std::atomic<int> next{0};
+    int total;
+    int threads;
+    std::chrono::nanoseconds target_batch;
+    int max_batch;
+};
+
+/* Состояние одного потока, забирающего задания из TaskDispenser */
+class TaskClaimer
+{
+public:
+    explicit TaskClaimer(TaskDispenser &dispenser) : dispenser(dispenser) {}
+
+    /*
+    Забирает следующую порцию [begin, end). Время с прошлого вызова считается
+    временем выполнения прошлой порции и уточняет размер следующей
+    */
+    bool next(int &begin, int &end)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (claimed > 0)
+        {
+            double per_task = std::chrono::duration<double, std::nano>(now - started).count() / claimed;
+            // Экспоненциальное сглаживание оценки стоимости задания
+            ns_per_task = ns_per_task == 0 ? per_task : ns_per_task + (per_task - ns_per_task) / 4;
+            batch = ns_per_task > 0 ? (int)(dispenser.target().count() / ns_per_task) : dispenser.batch_limit();
+            batch = std::max(1, std::min(batch, dispenser.batch_limit()));
+        }
+        int fair_share = dispenser.remaining() / (2 * dispenser.thread_count());
+        int count = std::max(1, std::min(batch, fair_share));
+        started = now;
+        if (!dispenser.claim(count, begin, end))
+        {
+            claimed = 0;
+            return false;
+        }
+        claimed = end - begin;
+        return true;
+    }
+
+    /* Текущий размер порции */
+    int batch_size() const { return batch; }
+
+private:
+    TaskDispenser &dispenser;
+    int batch = 1;            // Размер порции: начинаем с одного задания, пока стоимость неизвестна
+    int claimed = 0;          // Размер последней выданной порции
+    double ns_per_task = 0;   // Оценка стоимости одного задания
+    std::chrono::steady_clock::time_point started;
+};
+
+#endif